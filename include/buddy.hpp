@@ -28,6 +28,8 @@
 
 class Buddy : public List<Buddy>
 {
+    friend class Selftest;
+
     private:
         class Block
         {
@@ -50,9 +52,85 @@ class Buddy : public List<Buddy>
         mword           order   { 0 };
         Block *         index   { nullptr };
         Block *         head    { nullptr };
+        unsigned        node    { 0 };
 
         static Buddy * list;
 
+        /*
+         * Pools sorted by linear base address, so that free finds the owner
+         * of a block by binary search. Pools beyond pool_max are only found
+         * on the list.
+         */
+        static unsigned const pool_max = 16;
+
+        static Buddy *  pool[pool_max];
+        static unsigned pools;
+
+        static Buddy *owner (mword virt);
+
+        /*
+         * NUMA topology from the ACPI SRAT/SLIT. near[n] lists all nodes by
+         * increasing distance from node n. Without an SRAT nodes is 0 and
+         * pools are used in list order.
+         */
+        static unsigned nodes;
+        static uint8    near[NUM_NODE][NUM_NODE];
+
+        static unsigned home();
+
+        template <typename F>
+        static void *nearest (F fn)
+        {
+            if (!nodes) {
+                for (Buddy *b = list; b; b = b->next)
+                    if (void *v = fn (b))
+                        return v;
+
+                return nullptr;
+            }
+
+            uint8 const *n = near[home()];
+
+            for (unsigned i = 0; i < nodes; i++)
+                for (Buddy *b = list; b; b = b->next)
+                    if (b->node == n[i])
+                        if (void *v = fn (b))
+                            return v;
+
+            return nullptr;
+        }
+
+        /*
+         * Per-CPU cache of order-0 pages in front of the block lists. Its
+         * pages are marked used in their pool but not charged to any quota.
+         * A CPU only uses its cache once it runs on its CPU-local stack and
+         * while the kernel is not preemptible. The lock is only contended
+         * when an allocation that failed reclaims the caches of all CPUs.
+         */
+        static unsigned const pcp_max   = 32;
+        static unsigned const pcp_batch = pcp_max / 2;
+
+        /*
+         * The idle EC moves pages from the cache into a second list after
+         * zeroing them, so that FILL_0 requests need no memset. Other
+         * requests take them once the cache cannot be refilled.
+         */
+        static unsigned const pcp_zero  = 16;
+
+        static struct Pcp
+        {
+            Spinlock        lock            { };
+            unsigned long   count           { 0 };
+            unsigned long   zeroed          { 0 };
+            mword           page[pcp_max]   { };
+            mword           zero[pcp_zero]  { };
+        } pcp[NUM_CPU];
+
+        static Pcp *pcp_local();
+        static bool pcp_refill (Pcp &);
+        static void pcp_drain (Pcp &);
+        static bool pcp_reclaim();
+
         ALWAYS_INLINE
         inline signed long block_to_index (Block *b)
         {
@@ -89,6 +167,17 @@ class Buddy : public List<Buddy>
             return phys + reinterpret_cast<mword>(&OFFSET);
         }
 
+        ALWAYS_INLINE
+        inline bool owns (mword virt)
+        {
+            signed long idx = page_to_index (virt);
+            return idx >= min_idx && idx < max_idx;
+        }
+
+        mword take (unsigned short ord);
+
+        void give (mword virt);
+
     public:
         enum Fill
         {
@@ -99,6 +188,17 @@ class Buddy : public List<Buddy>
 
         static Buddy allocator;
 
+        /*
+         * True once the caller runs on its CPU-local stack, so that Cpu::id
+         * and other CPU-local data are set up.
+         */
+        ALWAYS_INLINE
+        static inline bool cpu_local()
+        {
+            mword sp;
+            return ((reinterpret_cast<mword>(&sp) - 1) & ~PAGE_MASK) == CPU_LOCAL_STCK;
+        }
+
         INIT
         Buddy (mword phys, mword virt, mword f_addr, size_t size);
 
@@ -106,6 +206,20 @@ class Buddy : public List<Buddy>
 
         static void free (mword addr, Quota &quota);
 
+        static bool prezero();
+
+        INIT
+        static void set_nodes (unsigned);
+
+        INIT
+        static void set_node (unsigned (*)(uint64, uint64));
+
+        INIT
+        static bool has_node (unsigned);
+
+        INIT
+        static void set_distance (unsigned, uint8 const *, unsigned);
+
      private:
 
         void *_alloc (unsigned short ord, Quota &quota, Fill fill);
@@ -49,6 +49,12 @@ class Cmdline
         static bool novpid;
         static bool logmem;
         static bool fpu_lazy;
+        static bool balance;
+        static bool sctrace;
+        static bool haltpoll;
+        static bool nomwait;
+        static bool edf;
+        static bool selftest;
 
         INIT
         static void init (char const *);
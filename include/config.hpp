@@ -24,6 +24,7 @@
 #define CFG_VER         9
 
 #define NUM_CPU         64
+#define NUM_NODE        8
 #define NUM_IRQ         16
 #define NUM_EXC         32
 #define PT_STARTUP      NUM_EXC - 2
@@ -37,6 +38,8 @@
 #define NUM_MSI         1
 #define NUM_IPI         4
 
+#define EDF_PRIO        64      /* priority of the EDF band, see "edf" option */
+
 #define SPN_SCH         0
 #define SPN_HLP         1
 #define SPN_RCU         2
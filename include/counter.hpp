@@ -38,7 +38,20 @@ class Counter
         static unsigned vtlb_flush      CPULOCAL;
         static unsigned schedule        CPULOCAL;
         static unsigned helping         CPULOCAL;
-        static uint64   cycles_idle     CPULOCAL;
+        static unsigned help_saved      CPULOCAL;   // chain hops skipped
+        static unsigned rrq_retry       CPULOCAL;
+        static unsigned rrq_coalesced   CPULOCAL;
+        static unsigned rrq_mwait       CPULOCAL;
+        static unsigned timer_set       CPULOCAL;
+        static unsigned timer_skip      CPULOCAL;
+        static unsigned steal           CPULOCAL;
+        static unsigned slab_mag        CPULOCAL;   // slab lock acquisitions avoided
+        static unsigned page_pcp        CPULOCAL;   // buddy lock acquisitions avoided
+        static unsigned page_zero_hit   CPULOCAL;   // FILL_0 served pre-zeroed
+        static unsigned page_zero_miss  CPULOCAL;   // FILL_0 zeroed on demand
+        static uint64   cycles_idle     CPULOCAL;   // halted
+        static uint64   cycles_poll     CPULOCAL;   // polled before halting
+        static uint64   cycles_zero     CPULOCAL;   // zeroed pages in idle
 
         static void dump();
 
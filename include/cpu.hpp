@@ -44,6 +44,9 @@ class Cpu
         ALWAYS_INLINE
         static inline void setup_pcid();
 
+        ALWAYS_INLINE
+        static inline void setup_mwait();
+
     public:
         enum Vendor
         {
@@ -65,9 +68,11 @@ class Cpu
             FEAT_MCA            = 14,
             FEAT_ACPI           = 22,
             FEAT_HTT            = 28,
+            FEAT_MONITOR        = 35,
             FEAT_VMX            = 37,
             FEAT_PCID           = 49,
             FEAT_TSC_DEADLINE   = 56,
+            FEAT_ARAT           = 66,
             FEAT_SMEP           = 103,
             FEAT_SMAP           = 116,
             FEAT_1GB_PAGES      = 154,
@@ -155,6 +160,7 @@ class Cpu
         static uint8    package[NUM_CPU];
         static uint8    core[NUM_CPU];
         static uint8    thread[NUM_CPU];
+        static uint8    node[NUM_CPU];
 
         static uint8    platform[NUM_CPU];
         static uint8    family[NUM_CPU];
@@ -162,6 +168,7 @@ class Cpu
         static uint8    stepping[NUM_CPU];
         static uint8    core_type[NUM_CPU];
         static unsigned patch[NUM_CPU];
+        static uint8    mwait_hint[NUM_CPU];
 
         static unsigned id                  CPULOCAL_HOT;
         static unsigned hazard              CPULOCAL_HOT;
@@ -46,6 +46,7 @@ class Ec : public Kobject, public Refcount, public Queue<Sc>
     friend class Queue<Ec>;
     friend class Sc;
     friend class Pt;
+    friend class Selftest;
 
     private:
         void        (*cont)() ALIGNED (16);
@@ -67,10 +68,22 @@ class Ec : public Kobject, public Refcount, public Queue<Sc>
         unsigned const evt;
         Timeout_hypercall timeout;
         mword          user_utcb;
+        unsigned       utcb_order { 0 };
 
         Sm *         xcpu_sm;
         Pt *         pt_oom;
 
+        /*
+         * Number of fixed SCs bound to this EC, or SC_MIGRATABLE for its
+         * only, migratable SC.
+         */
+        enum { SC_NONE = 0, SC_MIGRATABLE = ~0U };
+        unsigned     sc_bind { SC_NONE };
+
+        unsigned     batch      { 0 };      // entries of a pending SYS_BATCH
+        unsigned     batch_pos  { 0 };
+        bool         batch_stop { false };
+
         uint64      tsc  { 0 };
         uint64      time { 0 };
         uint64      time_m { 0 };
@@ -79,6 +92,17 @@ class Ec : public Kobject, public Refcount, public Queue<Sc>
 
         static Sm * auth_suspend;
 
+        /*
+         * Adaptive halt-polling: the idle EC spins for poll_window TSC ticks
+         * before halting. The window grows while wakeups arrive shortly after
+         * the CPU halted and shrinks when the CPU stays idle for longer.
+         */
+        static unsigned poll_window CPULOCAL;
+
+        static unsigned const poll_max_us = 50;
+
+        static bool idle_poll (uint64);
+
         REGPARM (1)
         static void handle_exc (Exc_regs *) asm ("exc_handler");
 
@@ -133,7 +157,7 @@ class Ec : public Kobject, public Refcount, public Queue<Sc>
             // remove mapping in page table
             if (e->user_utcb) {
                 e->pd->remove_utcb(e->user_utcb);
-                e->pd->Space_mem::insert (e->pd->quota, e->user_utcb, 0, 0, 0);
+                e->pd->Space_mem::insert (e->pd->quota, e->user_utcb, e->utcb_order, 0, 0);
                 e->user_utcb = 0;
             }
 
@@ -205,6 +229,7 @@ class Ec : public Kobject, public Refcount, public Queue<Sc>
             bool last = partner->del_ref();
             assert (!last);
             partner = nullptr;
+            Sc::chain_reply[Cpu::id]++;
             return Sc::ctr_link--;
         }
 
@@ -230,7 +255,7 @@ class Ec : public Kobject, public Refcount, public Queue<Sc>
         static Ec *ec_idle CPULOCAL;
 
         Ec (Pd *, void (*)(), unsigned);
-        Ec (Pd *, mword, Pd *, void (*)(), unsigned, unsigned, mword, mword, Pt *);
+        Ec (Pd *, mword, Pd *, void (*)(), unsigned, unsigned, mword, mword, Pt *, unsigned = 0);
         Ec (Pd *, Pd *, void (*f)(), unsigned, Ec *);
         Ec (Pd *, Pd *, void (*f)(), unsigned, Ec *, Pt *);
 
@@ -245,6 +270,10 @@ class Ec : public Kobject, public Refcount, public Queue<Sc>
         ALWAYS_INLINE
         inline bool blocked() const { return next || !cont; }
 
+        /* UTCB order that bounds a message between this EC and e */
+        ALWAYS_INLINE
+        inline unsigned xfer_order (Ec const *e) const { return min (utcb_order, e->utcb_order); }
+
         ALWAYS_INLINE
         inline void set_timeout (uint64 t, Sm *s)
         {
@@ -498,6 +527,14 @@ class Ec : public Kobject, public Refcount, public Queue<Sc>
         NORETURN
         static void sys_xcpu_call();
 
+        static Sc *xcpu_clone (unsigned);
+
+        NORETURN
+        static void batch_run();
+
+        NORETURN
+        static void batch_done();
+
         template <void (*)()>
         NORETURN
         static void sys_xcpu_call_oom();
@@ -560,4 +597,28 @@ class Ec : public Kobject, public Refcount, public Queue<Sc>
         {
             return regs.vtlb || regs.vmcb_state || regs.vmcs_state;
         }
+
+        /*
+         * A migratable SC must be the only SC of its EC, otherwise the
+         * remaining SCs would run the EC on its former CPU.
+         */
+        inline bool bind_sc (bool m)
+        {
+            if (m)
+                return !vcpu() && Atomic::cmp_swap (sc_bind, unsigned (SC_NONE), unsigned (SC_MIGRATABLE));
+
+            for (unsigned o; (o = ACCESS_ONCE (sc_bind)) != SC_MIGRATABLE; )
+                if (Atomic::cmp_swap (sc_bind, o, o + 1))
+                    return true;
+
+            return false;
+        }
+
+        inline void unbind_sc (bool m)
+        {
+            if (m)
+                sc_bind = SC_NONE;
+            else
+                Atomic::sub (sc_bind, 1U);
+        }
 };
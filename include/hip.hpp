@@ -51,7 +51,10 @@ class Hip_mem
             ACPI_XSDT   = -4u,
             MB2_FB      = -5u,
             HYP_LOG     = -6u,
-            SYSTAB      = -7u
+            SYSTAB      = -7u,
+            SC_TRACE    = -8u,
+            NUMA_MEM    = -9u,          // aux: node of the memory range
+            NUMA_CPU    = -10u          // addr: CPU mask of node aux
         };
 
         uint64  addr;
@@ -79,7 +82,7 @@ class Hip
         uint32  cfg_page;               // 0x28
         uint32  cfg_utcb;               // 0x2c
         uint32  freq_tsc;               // 0x30
-        uint32  reserved;               // 0x34
+        uint32  cfg_utcb_max;           // 0x34
         Hip_cpu cpu_desc[NUM_CPU];
         Hip_mem mem_desc[];
 
@@ -151,7 +154,10 @@ class Hip
         static void add_buddy (Hip_mem *&, Hip *, uint64 const, uint64 &, bool);
 
         INIT
-        static void _add_buddy (Hip_mem *&, Hip *, uint64 const, uint64 &, Hip_mem const &);
+        static void _add_buddy (Hip_mem *&, Hip *, uint64 const, uint64 &, Hip_mem const &, uint64 = 0);
+
+        INIT
+        static bool add_node_buddy (unsigned);
 
         template <typename T>
         INIT
@@ -27,6 +27,8 @@
 #include "space_obj.hpp"
 #include "space_pio.hpp"
 
+class Sc;
+
 class Pd : public Kobject, public Refcount, public Space_mem, public Space_pio, public Space_obj
 {
     private:
@@ -54,6 +56,8 @@ class Pd : public Kobject, public Refcount, public Space_mem, public Space_pio,
             pd->release_rid([&](uint16 const rid) {
                 Iommu::Interface::release(rid, pd);
             });
+
+            pd->xcpu_drain();
         }
 
         static void free (Rcu_elem * a) {
@@ -70,6 +74,21 @@ class Pd : public Kobject, public Refcount, public Space_mem, public Space_pio,
 
         static_assert (sizeof(rids_u) * 8 >= sizeof(rids) / sizeof(rids[0]), "rids_u too small");
 
+        /*
+         * Idle xCPU clone (Sc and its Ec) per CPU, see Ec::xcpu_clone. The
+         * pool holds the creation references. xcpu_closed marks the pool of
+         * a PD whose last capability is gone.
+         */
+        Sc *xcpu_pool[NUM_CPU] { };
+
+        ALWAYS_INLINE
+        static inline Sc *xcpu_closed() { return reinterpret_cast<Sc *>(~0UL); }
+
+        void xcpu_drain();
+
+        Pd (Pd const &);
+        Pd &operator = (Pd const &);
+
     public:
         static Pd *current CPULOCAL_HOT;
         static Pd kern, root;
@@ -89,6 +108,9 @@ class Pd : public Kobject, public Refcount, public Space_mem, public Space_pio,
 
         Pd (Pd *own, mword sel, mword a);
 
+        Sc *xcpu_take (unsigned);
+        bool xcpu_give (Sc *);
+
         ALWAYS_INLINE HOT
         inline void make_current()
         {
@@ -145,6 +167,7 @@ class Pd : public Kobject, public Refcount, public Space_mem, public Space_pio,
 
         void xlt_crd (Pd *, Crd, Crd &);
         void del_crd (Pd *, Crd, Crd &, mword = 0, mword = 0);
+        void mov_crd (Pd *, Crd, Crd &, mword = 0, mword = 0);
         void rev_crd (Crd, bool, bool, bool);
 
         void assign_rid(uint16 r);
@@ -22,43 +22,161 @@
 
 #pragma once
 
+#include "bits.hpp"
+#include "cmdline.hpp"
 #include "compiler.hpp"
+#include "sc_trace.hpp"
+#include "timeout_budget.hpp"
 
 class Ec;
 
 class Sc : public Kobject, public Refcount
 {
     friend class Queue<Sc>;
+    friend class Timeout_budget;
+    friend class Timeout_replenish;
+    friend class Selftest;
 
     public:
         Refptr<Ec> const ec;
-        unsigned const cpu;
+        unsigned       cpu;
         uint16   const prio;
         uint16         disable { 0 };
         uint64   const budget;
         uint64         time    { 0 };
         uint64         time_m  { 0 };
+        bool     const migratable;
+        bool           bound   { false };   // counted in Ec::sc_bind
+
+        /*
+         * Reservation: an SC with a period may consume at most budget within
+         * each period. The period starts when the SC becomes ready with an
+         * elapsed previous period. A depleted SC leaves the ready list until
+         * replenish fires at the end of its period.
+         */
+        uint64   const period;
+        uint64         period_start { 0 };
+        unsigned       depleted     { 0 };
+
+        /*
+         * EDF band: with the "edf" option, SCs at edf_prio are reservations
+         * ordered by the end of their current period. util is the admitted
+         * share of the CPU in 1/edf_max units, 0 for all other SCs. An xCPU
+         * clone of such an SC runs in the band without a period and keeps
+         * the deadline of the SC it was cloned from.
+         */
+        unsigned const util;
+
+        /*
+         * Helping-chain cache: end and length of the partner chain that was
+         * last walked from chain_ec. Between replies chains only grow at
+         * their end, so the cache stays valid while chain_gen matches the
+         * reply generation of the CPU.
+         */
+        Ec *     chain_ec  { nullptr };
+        Ec *     chain_end { nullptr };
+        unsigned chain_len { 0 };
+        unsigned chain_cpu { 0 };
+        mword    chain_gen { 0 };
+
+        static mword chain_reply[NUM_CPU];
 
         static unsigned const priorities = 128;
+        static unsigned const edf_prio   = EDF_PRIO;
+        static unsigned const edf_max    = 1024;
+
+        static_assert (edf_prio && edf_prio < priorities, "EDF band out of range");
 
     private:
         uint64 left;
         Sc *prev { nullptr }, *next { nullptr };
         uint64 tsc { 0 };
+        uint64 deadline { 0 };
+        uint64 wake { 0 };
+        unsigned slot { ~0U };
+
+        Timeout_replenish replenish { this };
 
+        static unsigned edf_util[NUM_CPU];
+
+        ALWAYS_INLINE
+        inline bool edf() const { return Cmdline::edf && prio == edf_prio; }
+
+        void edf_insert();
+
+        /*
+         * Remote run queue: multi-producer (any CPU), single-consumer (owner
+         * CPU) stack, linked through Sc::next and drained by rrq_handler.
+         * While mwait is set the owner monitors queue, so the store of a
+         * producer wakes it and no IPI is required.
+         */
         static struct Rq {
-            Spinlock    lock { };
             Sc *        queue { nullptr };
+            mword       mwait { 0 };
         } rq CPULOCAL;
 
+        static Sc *rrq_take();
+
         static Sc *list[priorities] CPULOCAL;
 
-        static unsigned prio_top CPULOCAL;
+        /*
+         * Two-level priority bitmap: bit p of prio_map[p / word] is set if
+         * list[p] is non-empty, bit i of prio_idx is set if prio_map[i] != 0.
+         */
+        static unsigned const prio_word = sizeof (mword) * 8;
+
+        static mword prio_map[priorities / prio_word] CPULOCAL;
+        static mword prio_idx CPULOCAL;
+
+        static_assert (priorities / prio_word <= prio_word, "prio_idx too small");
+
+        ALWAYS_INLINE
+        static inline void prio_set (unsigned p)
+        {
+            prio_map[p / prio_word] |= 1UL << p % prio_word;
+            prio_idx                |= 1UL << p / prio_word;
+        }
+
+        ALWAYS_INLINE
+        static inline void prio_clr (unsigned p)
+        {
+            if (!(prio_map[p / prio_word] &= ~(1UL << p % prio_word)))
+                prio_idx &= ~(1UL << p / prio_word);
+        }
+
+        ALWAYS_INLINE
+        static inline unsigned prio_top()
+        {
+            if (EXPECT_FALSE (!prio_idx))
+                return 0;
+
+            unsigned i = static_cast<unsigned>(bit_scan_reverse (prio_idx));
+
+            return i * prio_word + static_cast<unsigned>(bit_scan_reverse (prio_map[i]));
+        }
+
+        /*
+         * Load balancing: number of ready migratable SCs per CPU, pending
+         * steal request (requesting CPU + 1) per CPU, and time of the last
+         * request a CPU could not serve. Idle CPUs leave such a CPU alone
+         * for steal_backoff_us.
+         */
+        static unsigned ready_mig[NUM_CPU];
+        static unsigned steal_req[NUM_CPU];
+        static uint64   steal_fail[NUM_CPU];
+
+        static unsigned const steal_backoff_us = 1000;
 
         void ready_enqueue (uint64, bool, bool = true);
 
         void ready_dequeue (uint64);
 
+        bool stealable (unsigned) const;
+
+        static void give();
+
+        static void park();
+
         static void free (Rcu_elem * a) {
             Sc * s = static_cast<Sc *>(a);
               
@@ -96,6 +214,7 @@ class Sc : public Kobject, public Refcount
         static unsigned ctr_link    CPULOCAL;
         static unsigned ctr_loop    CPULOCAL;
         static uint64   long_loop   CPULOCAL;
+        static Sc *     xcpu_park   CPULOCAL;   // xCPU clone to pool once switched away
         static uint64   cross_time[NUM_CPU];
         static uint64   killed_time[NUM_CPU];
 
@@ -103,21 +222,49 @@ class Sc : public Kobject, public Refcount
         static unsigned const default_quantum = 10000;
 
         Sc (Pd *, mword, Ec *);
-        Sc (Pd *, mword, Ec *, unsigned, unsigned, unsigned);
+        Sc (Pd *, mword, Ec *, unsigned, unsigned, unsigned, bool = false, unsigned = 0);
         Sc (Pd *, Ec *, unsigned, Sc *);
         Sc (Pd *, Ec *, Sc &);
 
+        ~Sc();
+
+        ALWAYS_INLINE
+        inline void xcpu_reuse (Sc const *x) { left = x->left; deadline = x->deadline; }
+
+        static unsigned edf_share (unsigned q, unsigned t)
+        {
+            uint32 dummy;
+            return static_cast<unsigned>(div64 (static_cast<uint64>(q) * edf_max + t - 1, t, &dummy));
+        }
+
+        static bool edf_admit (unsigned, unsigned);
+
         ALWAYS_INLINE
         static inline Rq *remote (unsigned long c)
         {
             return reinterpret_cast<typeof rq *>(reinterpret_cast<mword>(&rq) - CPU_LOCAL_DATA + HV_GLOBAL_CPUS + c * PAGE_SIZE);
         }
 
+        ALWAYS_INLINE
+        static inline Sc *remote_current (unsigned long c)
+        {
+            return *reinterpret_cast<Sc **>(reinterpret_cast<mword>(&current) - CPU_LOCAL_DATA + HV_GLOBAL_CPUS + c * PAGE_SIZE);
+        }
+
         void remote_enqueue(bool = true);
 
+        uint64 consumed() const;
+
         static void rrq_handler();
         static void rke_handler();
 
+        ALWAYS_INLINE
+        static inline bool rq_pending() { return ACCESS_ONCE (rq.queue); }
+
+        static void mwait (unsigned);
+
+        static void steal();
+
         NORETURN
         static void schedule (bool = false, bool = true);
 
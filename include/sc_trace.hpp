@@ -0,0 +1,137 @@
+/*
+ * Scheduler Event Trace
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "barrier.hpp"
+#include "compiler.hpp"
+#include "config.hpp"
+#include "cpu.hpp"
+#include "memory.hpp"
+#include "spinlock.hpp"
+#include "types.hpp"
+
+/*
+ * Binary scheduler trace, enabled with the "sctrace" command-line option.
+ * The region is announced in the HIP (Hip_mem::SC_TRACE) and can be mapped
+ * read-only by the roottask. Layout:
+ *
+ *   page 0            Header (head[c] counts the events written by CPU c)
+ *   pages 1..8        Hist[hist_slots] - wakeup-to-run latency per SC
+ *   pages 9..         Event[ring_events] ring of each online CPU
+ *
+ * A ring is written by its CPU only. The event at head % ring_events is
+ * complete once head has been advanced beyond it.
+ */
+class Sc_trace
+{
+    public:
+        enum Type
+        {
+            ENQUEUE,
+            DEQUEUE,
+            SWITCH,
+            WAKEUP_IPI,
+            BUDGET,
+            DEPLETED,
+        };
+
+        struct Event
+        {
+            uint64  tsc;
+            uint32  slot;               // Hist slot of the SC, ~0U if none
+            uint16  type;
+            uint16  arg;                // priority or CPU
+        };
+
+        struct Hist
+        {
+            uint64  sel;                // SC selector + 1, 0 if the slot is free
+            uint16  cpu;
+            uint16  prio;
+            uint32  count;
+            uint64  max;
+            uint64  sum;
+            uint32  bucket[24];         // [2^(i+8), 2^(i+9)) TSC ticks
+        };
+
+        struct Header
+        {
+            uint32  cpus;
+            uint32  ring_events;
+            uint32  hist_slots;
+            uint32  reserved[13];
+            uint64  head[NUM_CPU];
+        };
+
+        static unsigned const hist_slots  = 256;
+        static unsigned const ring_events = 1024;
+        static unsigned const hist_pages  = hist_slots * sizeof (Hist) / PAGE_SIZE;
+        static unsigned const ring_pages  = ring_events * sizeof (Event) / PAGE_SIZE;
+
+        static_assert (sizeof (Event) == 16 && sizeof (Hist) == 128, "Sc_trace layout");
+        static_assert (sizeof (Header) <= PAGE_SIZE, "Sc_trace header too large");
+
+    private:
+        static Header * header;
+        static mword    size;
+        static Spinlock lock;
+
+        ALWAYS_INLINE
+        static inline Hist *hist()
+        {
+            return reinterpret_cast<Hist *>(reinterpret_cast<mword>(header) + PAGE_SIZE);
+        }
+
+        ALWAYS_INLINE
+        static inline Event *ring (unsigned c)
+        {
+            return reinterpret_cast<Event *>(reinterpret_cast<mword>(hist()) + (hist_pages + c * ring_pages) * PAGE_SIZE);
+        }
+
+    public:
+        ALWAYS_INLINE
+        static inline bool enabled() { return header; }
+
+        ALWAYS_INLINE
+        static inline void event (Type type, unsigned slot, unsigned arg, uint64 tsc)
+        {
+            if (EXPECT_TRUE (!header))
+                return;
+
+            uint64 h = header->head[Cpu::id];
+            Event &e = ring (Cpu::id)[h % ring_events];
+
+            e.tsc  = tsc;
+            e.slot = slot;
+            e.type = static_cast<uint16>(type);
+            e.arg  = static_cast<uint16>(arg);
+
+            barrier();
+
+            header->head[Cpu::id] = h + 1;
+        }
+
+        static void latency (unsigned, uint64);
+
+        static unsigned alloc (mword, unsigned, unsigned);
+        static void free (unsigned);
+
+        static mword phys();
+
+        static mword bytes() { return size; }
+
+        static void init();
+};
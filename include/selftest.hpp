@@ -0,0 +1,59 @@
+/*
+ * Boot-Time Self Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include "compiler.hpp"
+#include "slab.hpp"
+#include "types.hpp"
+
+/*
+ * Stress tests for the lock-free and per-CPU paths of the kernel. They run
+ * on all online CPUs at once during bootstrap, before the root task exists
+ * and with interrupts disabled, and panic on the first violated invariant.
+ */
+class Selftest
+{
+    private:
+        static mword arrived;
+        static mword generation;
+
+        static Slab_cache cache;
+
+        static void rendezvous();
+        static bool expired (uint64);
+        static uint64 deadline();
+
+        static void check (bool, char const *);
+
+        static unsigned nth_cpu (unsigned);
+        static unsigned rank();
+        static unsigned random (unsigned &);
+
+        static void *page();
+        static void free (void *);
+
+        static void pages();
+        static void prio();
+        static void rrq();
+        static void slab();
+        static void steal();
+        static void timeout();
+        static void sm();
+        static void sm_ring();
+
+    public:
+        static void run();
+};
@@ -32,11 +32,36 @@ class Slab_cache
         Slab *      curr;
         Slab *      head;
 
+        /*
+         * Per-CPU magazines in front of the slabs. The page holding them is
+         * taken from the quota of the cache owner once the cache grows beyond
+         * one slab and the quota has room for it. A magazine is only used by
+         * its CPU on the CPU-local stack while the kernel is not preemptible,
+         * so it needs no lock.
+         */
+        struct Magazine
+        {
+            unsigned long   rounds;
+            void *          round[PAGE_SIZE / NUM_CPU / sizeof (void *) - 1];
+        };
+
+        static unsigned long const mag_rounds = sizeof (Magazine::round) / sizeof (void *);
+
+        static_assert (sizeof (Magazine) * NUM_CPU == PAGE_SIZE, "Magazine layout");
+        static_assert (mag_rounds >= 2, "Magazine too small");
+
+        Magazine *  mag { nullptr };
+
+        Magazine *magazine();
+
         /*
          * Back end allocator
          */
         void grow(Quota &quota);
 
+        void *get();
+        void put (void *ptr, Quota &quota);
+
         Slab_cache (const Slab_cache&);
         Slab_cache &operator = (Slab_cache const &);
 
@@ -27,9 +27,57 @@
 
 class Sm : public Kobject, public Refcount, public Queue<Ec>, public Queue<Si>, public Si
 {
+    friend class Selftest;
+
     private:
         mword counter;
 
+        /*
+         * A doorbell saturates at one: any number of ups while nobody waits
+         * results in a single wakeup, so a producer may ring it for every
+         * batch it adds to a shared ring without piling up wakeups.
+         */
+        bool const doorbell;
+
+        /*
+         * A signal set is a doorbell that accumulates the values of chained
+         * signals in a one-word bitmap (bit value, so values are limited to
+         * the word size) instead of queueing them, so a single dn returns
+         * all pending signals at once. The bitmap may be empty after a
+         * wakeup that raced with a previous dn.
+         */
+        bool const sigset;
+        mword      pending     { 0 };
+        mword      pending_cnt { 0 };
+
+        /*
+         * Waiters are only queued while the counter is zero, so a positive
+         * counter may be taken or raised with cmpxchg without the lock.
+         */
+        ALWAYS_INLINE
+        inline bool dn_fast (bool zero)
+        {
+            for (mword c; (c = ACCESS_ONCE (counter)); )
+                if (Atomic::cmp_swap (counter, c, zero ? 0 : c - 1))
+                    return true;
+
+            return false;
+        }
+
+        ALWAYS_INLINE
+        inline void dn_si (Ec *ec)
+        {
+            if (sigset) {
+                mword c = Atomic::exchange (pending_cnt, 0UL);
+                ec->set_si_regs (Atomic::exchange (pending, 0UL), c);
+                return;
+            }
+
+            Si * si;
+            if (Queue<Si>::dequeue(si = Queue<Si>::head()))
+                ec->set_si_regs(si->value, static_cast <Sm *>(si)->reset());
+        }
+
         static void free (Rcu_elem * a) {
             Sm * sm = static_cast <Sm *>(a);
 
@@ -51,13 +99,20 @@ class Sm : public Kobject, public Refcount, public Queue<Ec>, public Queue<Si>,
 
         mword reset(bool l = false) {
             if (l) lock.lock();
-            mword c = counter;
-            counter = 0;
+            mword c = Atomic::exchange (counter, 0UL);
             if (l) lock.unlock();
             return c;
         }
 
-        Sm (Pd *, mword, mword = 0, Sm * = nullptr, mword = 0);
+        Sm (Pd *, mword, mword = 0, Sm * = nullptr, mword = 0, bool = false, bool = false);
+
+        /*
+         * Signals may only be chained to a doorbell if it is a signal set,
+         * a saturated counter cannot account for queued signals. A signal
+         * chained to a set must name a bit of its bitmap.
+         */
+        ALWAYS_INLINE
+        inline bool chainable (mword v) const { return !doorbell || (sigset && v < sizeof (mword) * 8); }
         ~Sm ()
         {
             while (!counter)
@@ -67,15 +122,21 @@ class Sm : public Kobject, public Refcount, public Queue<Ec>, public Queue<Si>,
         ALWAYS_INLINE
         inline void dn (bool zero, uint64 t, Ec *ec = Ec::current, bool block = true)
         {
-            {   Lock_guard <Spinlock> guard (lock);
+            if (EXPECT_TRUE (dn_fast (zero))) {
+                if (EXPECT_FALSE (sigset))
+                    dn_si (ec);
+                else if (EXPECT_FALSE (Queue<Si>::head())) {
+                    Lock_guard <Spinlock> guard (lock);
+                    dn_si (ec);
+                }
 
-                if (counter) {
-                    counter = zero ? 0 : counter - 1;
+                return;
+            }
 
-                    Si * si;
-                    if (Queue<Si>::dequeue(si = Queue<Si>::head()))
-                        ec->set_si_regs(si->value, static_cast <Sm *>(si)->reset());
+            {   Lock_guard <Spinlock> guard (lock);
 
+                if (dn_fast (zero)) {
+                    dn_si (ec);
                     return;
                 }
 
@@ -102,6 +163,18 @@ class Sm : public Kobject, public Refcount, public Queue<Ec>, public Queue<Si>,
         {
             Ec *ec = nullptr;
 
+            if (EXPECT_TRUE (!si)) {
+                mword o = ACCESS_ONCE (counter);
+
+                /*
+                 * A doorbell that is already rung stays unchanged, but the
+                 * locked cmpxchg still drains the caller's prior stores, so
+                 * a dn that takes the counter sees what was published.
+                 */
+                if (o && Atomic::cmp_swap (counter, o, doorbell ? o : o + 1))
+                    return;
+            }
+
             do {
                 if (ec)
                     Rcu::call (ec);
@@ -110,18 +183,26 @@ class Sm : public Kobject, public Refcount, public Queue<Ec>, public Queue<Si>,
 
                     if (!Queue<Ec>::dequeue (ec = Queue<Ec>::head())) {
 
-                        if (si) {
+                        if (si && sigset) {
+                            Atomic::set_mask (pending, 1UL << si->value);
+                            Atomic::add (pending_cnt, si->reset(true));
+                        } else if (si) {
                            if (si->queued()) return;
                            Queue<Si>::enqueue(si);
                         }
 
-                        counter++;
+                        if (!doorbell || !counter)
+                            Atomic::add (counter, 1UL);
                         return;
                     }
 
                 }
 
-                if (si) ec->set_si_regs(si->value, si->reset(true));
+                if (si && sigset)
+                    ec->set_si_regs(1UL << si->value | Atomic::exchange (pending, 0UL),
+                                    si->reset(true) + Atomic::exchange (pending_cnt, 0UL));
+                else if (si)
+                    ec->set_si_regs(si->value, si->reset(true));
 
                 ec->release (c);
 
@@ -42,6 +42,12 @@ class Space_obj : public Space
     public:
         static unsigned const caps = (END_SPACE_LIM - SPC_LOCAL_OBJ) / sizeof (Capability);
 
+        /*
+         * Capabilities of the current PD are read through the CPU-local
+         * capability window: a single load, with the backing page faulted
+         * in once per CPU. Revocation just clears the slot, so there is no
+         * separate lookup cache that would need invalidation.
+         */
         ALWAYS_INLINE
         static inline Capability lookup (unsigned long idx)
         {
@@ -72,6 +72,9 @@ class Sys_create_ec : public Sys_regs
         ALWAYS_INLINE
         inline mword utcb() const { return ARG_3 & ~0xfff; }
 
+        ALWAYS_INLINE
+        inline unsigned utcb_order() const { return flags() >> 1; }
+
         ALWAYS_INLINE
         inline mword esp() const { return ARG_4; }
 
@@ -93,6 +96,15 @@ class Sys_create_sc : public Sys_regs
 
         ALWAYS_INLINE
         inline Qpd qpd() const { return Qpd (ARG_4); }
+
+        ALWAYS_INLINE
+        inline bool migratable() const { return flags() & 0x1; }
+
+        ALWAYS_INLINE
+        inline unsigned period() const { return flags() & 0x2 ? static_cast<unsigned>(ARG_5) : 0; }
+
+        ALWAYS_INLINE
+        inline bool edf() const { return flags() & 0x4; }
 };
 
 class Sys_create_pt : public Sys_regs
@@ -128,6 +140,12 @@ class Sys_create_sm : public Sys_regs
 
         ALWAYS_INLINE
         inline unsigned long sm() const { return ARG_4; }
+
+        ALWAYS_INLINE
+        inline bool doorbell() const { return flags() & 0x1; }
+
+        ALWAYS_INLINE
+        inline bool sigset() const { return flags() & 0x2; }
 };
 
 class Sys_revoke : public Sys_regs
@@ -157,7 +175,10 @@ class Sys_revoke : public Sys_regs
 class Sys_misc : public Sys_regs
 {
     public:
-        enum { SYS_LOOKUP = 0, SYS_DELEGATE = 1, SYS_ACPI_SUSPEND };
+        enum { SYS_LOOKUP = 0, SYS_DELEGATE = 1, SYS_ACPI_SUSPEND, SYS_BATCH };
+
+        /* SYS_BATCH entry: ARG_1 .. ARG_5 of one system call */
+        static unsigned const batch_words = 5;
 
         ALWAYS_INLINE
         inline Crd & crd() { return reinterpret_cast<Crd &>(ARG_2); }
@@ -173,6 +194,9 @@ class Sys_misc : public Sys_regs
 
         ALWAYS_INLINE
         inline mword sleep_type_b() const { return ARG_3; }
+
+        ALWAYS_INLINE
+        inline bool batch_stop() const { return ARG_2 & 0x1; }
 };
 
 class Sys_reply : public Sys_regs
@@ -225,6 +249,9 @@ class Sys_sc_ctrl : public Sys_regs
         ALWAYS_INLINE
         inline unsigned op() const { return flags() & 0x3; }
 
+        ALWAYS_INLINE
+        inline bool budget() const { return flags() & 0x8; }
+
         ALWAYS_INLINE
         inline void set_time (uint64 val)
         {
@@ -20,10 +20,15 @@
 #include "compiler.hpp"
 #include "types.hpp"
 
+/*
+ * Timeouts of a CPU are kept in an intrusive pairing heap with the earliest
+ * timeout at the root. A node links to its first child, its next sibling,
+ * and its previous sibling or, if it is the first child, to its parent.
+ */
 class Timeout
 {
     protected:
-        Timeout *prev, *next;
+        Timeout *prev, *next, *child;
         uint64 time;
 
         virtual void trigger() = 0;
@@ -31,11 +36,19 @@ class Timeout
         Timeout(const Timeout&);
         Timeout &operator = (Timeout const &);
 
+    private:
+        static uint64 armed CPULOCAL;
+
+        static Timeout *meld (Timeout *, Timeout *);
+        static Timeout *merge_pairs (Timeout *);
+
+        static void program (uint64, bool = false);
+
     public:
         static Timeout *list CPULOCAL;
 
         ALWAYS_INLINE
-        inline Timeout() : prev (nullptr), next (nullptr), time (0) {}
+        inline Timeout() : prev (nullptr), next (nullptr), child (nullptr), time (0) {}
 
         ALWAYS_INLINE
         ~Timeout() { if (active()) dequeue(); }
@@ -48,4 +61,7 @@ class Timeout
 
         static void check();
         static void sync();
+
+        ALWAYS_INLINE
+        static inline uint64 earliest() { return list ? list->time : ~0ULL; }
 };
@@ -19,6 +19,8 @@
 
 #include "timeout.hpp"
 
+class Sc;
+
 class Timeout_budget : public Timeout
 {
     private:
@@ -27,3 +29,18 @@ class Timeout_budget : public Timeout
     public:
         static Timeout_budget budget CPULOCAL;
 };
+
+class Timeout_replenish : public Timeout
+{
+    private:
+        Sc * const sc;
+
+        Timeout_replenish(const Timeout_replenish&);
+        Timeout_replenish &operator = (Timeout_replenish const &);
+
+        void trigger();
+
+    public:
+        ALWAYS_INLINE
+        inline Timeout_replenish (Sc *s) : sc (s) {}
+};
@@ -98,9 +98,20 @@ class Utcb_data
 class Utcb : public Utcb_head, private Utcb_data
 {
     private:
-        static mword const words = (PAGE_SIZE - sizeof (Utcb_head)) / sizeof (mword);
+        static mword const copy_rep = 32;
+
+        ALWAYS_INLINE
+        static inline mword words (unsigned o) { return ((PAGE_SIZE << o) - sizeof (Utcb_head)) / sizeof (mword); }
 
     public:
+        /*
+         * A UTCB spans 2^order pages, chosen at EC creation. Untyped words
+         * extend from the header, typed items grow down from the end of
+         * the last page. The register layout for exceptions and vCPUs
+         * always lives in the first page.
+         */
+        static unsigned const order_max = 4;
+
         WARN_UNUSED_RESULT bool load_exc (Cpu_regs *);
         WARN_UNUSED_RESULT bool load_vmx (Cpu_regs *);
         WARN_UNUSED_RESULT bool load_svm (Cpu_regs *);
@@ -111,29 +122,40 @@ class Utcb : public Utcb_head, private Utcb_data
         inline mword ucnt() const { return static_cast<uint16>(items); }
         inline mword tcnt() const { return static_cast<uint16>(items >> 16); }
 
-        inline mword ui() const { return min (words / 1, ucnt()); }
-        inline mword ti() const { return min (words / 2, tcnt()); }
+        inline mword ui (unsigned o = 0) const { return min (words (o) / 1, ucnt()); }
+        inline mword ti (unsigned o = 0) const { return min (words (o) / 2, tcnt()); }
 
+        /* o is the smaller order of both UTCBs */
         ALWAYS_INLINE NONNULL
-        inline void save (Utcb *dst)
+        inline void save (Utcb *dst, unsigned o = 0)
         {
-            mword n = ui();
-
-            dst->items = items;
-#if 0
+            mword n = ui (o);
             mword *d = dst->mr, *s = mr;
-            asm volatile ("rep; movsl" : "+D" (d), "+S" (s), "+c" (n) : : "memory");
+
+            dst->items = (items & ~0xffffUL) | n;
+
+            /* string move only pays off once its startup cost is amortized */
+            if (n >= copy_rep) {
+#ifdef __x86_64__
+                asm volatile ("rep; movsq" : "+D" (d), "+S" (s), "+c" (n) : : "memory");
 #else
-            for (unsigned long i = 0; i < n; i++)
-                dst->mr[i] = mr[i];
+                asm volatile ("rep; movsl" : "+D" (d), "+S" (s), "+c" (n) : : "memory");
 #endif
+                return;
+            }
+
+            for (unsigned long i = 0; i < n; i++)
+                d[i] = s[i];
         }
 
         ALWAYS_INLINE
-        inline Xfer *xfer() { return reinterpret_cast<Xfer *>(this) + PAGE_SIZE / sizeof (Xfer) - 1; }
+        inline Xfer *xfer (unsigned o = 0) { return reinterpret_cast<Xfer *>(this) + (PAGE_SIZE << o) / sizeof (Xfer) - 1; }
+
+        ALWAYS_INLINE
+        inline mword *untyped() { return mr; }
 
         ALWAYS_INLINE
-        static inline void *operator new (size_t, Quota &quota) { return Buddy::allocator.alloc (0, quota, Buddy::FILL_0); }
+        static inline void *operator new (size_t, Quota &quota, unsigned o = 0) { return Buddy::allocator.alloc (static_cast<unsigned short>(o), quota, Buddy::FILL_0); }
 
         ALWAYS_INLINE
         static inline void destroy(Utcb *obj, Quota &quota) { obj->~Utcb(); Buddy::allocator.free (reinterpret_cast<mword>(obj), quota); }
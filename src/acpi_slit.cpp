@@ -0,0 +1,28 @@
+/*
+ * Advanced Configuration and Power Interface (ACPI)
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "acpi_slit.hpp"
+#include "buddy.hpp"
+
+void Acpi_table_slit::parse() const
+{
+    if (localities > 256 || sizeof (*this) + localities * localities > length)
+        return;
+
+    unsigned n = static_cast<unsigned>(localities);
+
+    for (unsigned i = 0; i < min (n, static_cast<unsigned>(NUM_NODE)); i++)
+        Buddy::set_distance (i, distance + i * n, n);
+}
@@ -0,0 +1,123 @@
+/*
+ * Advanced Configuration and Power Interface (ACPI)
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "acpi_srat.hpp"
+#include "buddy.hpp"
+#include "cpu.hpp"
+#include "hip.hpp"
+
+Acpi_table_srat::Range  Acpi_table_srat::range[ranges];
+unsigned                Acpi_table_srat::count;
+
+void Acpi_table_srat::parse() const
+{
+    parse_entry (Acpi_affinity::LAPIC,  &parse_lapic);
+    parse_entry (Acpi_affinity::X2APIC, &parse_x2apic);
+    parse_entry (Acpi_affinity::MEMORY, &parse_mem);
+
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < Cpu::online; i++)
+        n = max (n, Cpu::node[i] + 1U);
+
+    for (unsigned i = 0; i < count; i++)
+        n = max (n, range[i].node + 1);
+
+    Buddy::set_nodes (n);
+    Buddy::set_node (&node_of);
+
+    // The boot pools all lie next to the hypervisor, add one for each other node
+    bool added = false;
+
+    for (unsigned i = 0; i < n; i++)
+        if (!Buddy::has_node (i))
+            added |= Hip::add_node_buddy (i);
+
+    if (added)
+        Buddy::set_node (&node_of);
+}
+
+/*
+ * Node that holds the largest part of a physical range, 0 if none.
+ */
+unsigned Acpi_table_srat::node_of (uint64 base, uint64 size)
+{
+    unsigned node = 0;
+    uint64   best = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+
+        uint64 s = max (base, range[i].base);
+        uint64 e = min (base + size, range[i].base + range[i].size);
+
+        if (e > s && e - s > best) {
+            best = e - s;
+            node = range[i].node;
+        }
+    }
+
+    return node;
+}
+
+void Acpi_table_srat::parse_entry (Acpi_affinity::Type type, void (*handler)(Acpi_affinity const *)) const
+{
+    for (Acpi_affinity const *ptr = affinity; ptr < reinterpret_cast<Acpi_affinity *>(reinterpret_cast<mword>(this) + length); ptr = reinterpret_cast<Acpi_affinity *>(reinterpret_cast<mword>(ptr) + ptr->length)) {
+
+        if (EXPECT_FALSE (!ptr->length))
+            break;
+
+        if (ptr->type == type)
+            (*handler)(ptr);
+    }
+}
+
+void Acpi_table_srat::parse_cpu (unsigned apic_id, unsigned dom)
+{
+    if (dom >= NUM_NODE)
+        return;
+
+    for (unsigned i = 0; i < Cpu::online; i++)
+        if (Cpu::apic_id[i] == apic_id)
+            Cpu::node[i] = static_cast<uint8>(dom);
+}
+
+void Acpi_table_srat::parse_lapic (Acpi_affinity const *ptr)
+{
+    Acpi_affinity_lapic const *p = static_cast<Acpi_affinity_lapic const *>(ptr);
+
+    if (p->flags & 1)
+        parse_cpu (p->apic_id, p->dom_lo | p->dom_hi[0] << 8 | p->dom_hi[1] << 16 | p->dom_hi[2] << 24);
+}
+
+void Acpi_table_srat::parse_x2apic (Acpi_affinity const *ptr)
+{
+    Acpi_affinity_x2apic const *p = static_cast<Acpi_affinity_x2apic const *>(ptr);
+
+    if (p->flags & 1 && p->x2apic_id < 256)
+        parse_cpu (p->x2apic_id, p->dom);
+}
+
+void Acpi_table_srat::parse_mem (Acpi_affinity const *ptr)
+{
+    Acpi_affinity_mem const *p = static_cast<Acpi_affinity_mem const *>(ptr);
+
+    if (!(p->flags & 1) || !p->size || p->dom >= NUM_NODE || count == ranges)
+        return;
+
+    range[count].base = p->base;
+    range[count].size = p->size;
+    range[count].node = p->dom;
+    count++;
+}
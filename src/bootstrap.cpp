@@ -26,6 +26,7 @@
 #include "console_serial.hpp"
 #include "acpi.hpp"
 #include "ioapic.hpp"
+#include "selftest.hpp"
 
 extern "C" NORETURN
 void bootstrap()
@@ -70,8 +71,12 @@ void bootstrap()
 
     Msr::write<uint64>(Msr::IA32_TSC, 0);
 
+    if (Cmdline::selftest)
+        Selftest::run();
+
     // Create root task
     if (Cpu::bsp) {
+        Sc_trace::init();
         Hip::add_check();
         Ec *root_ec = new (Pd::root) Ec (&Pd::root, EC_ROOTTASK, &Pd::root, Ec::root_invoke, Cpu::id, 0, USER_ADDR - 2 * PAGE_SIZE, 0, nullptr);
         Sc *root_sc = new (Pd::root) Sc (&Pd::root, SC_ROOTTASK, root_ec, Cpu::id, Sc::default_prio, Sc::default_quantum);
@@ -21,6 +21,7 @@
 #include "assert.hpp"
 #include "bits.hpp"
 #include "buddy.hpp"
+#include "counter.hpp"
 #include "initprio.hpp"
 #include "lock_guard.hpp"
 #include "stdio.hpp"
@@ -44,6 +45,14 @@ Buddy Buddy::allocator (reinterpret_cast<mword>(&_mempool_p),
 
 Buddy * Buddy::list;
 
+Buddy *  Buddy::pool[pool_max];
+unsigned Buddy::pools;
+
+Buddy::Pcp Buddy::pcp[NUM_CPU];
+
+unsigned Buddy::nodes;
+uint8    Buddy::near[NUM_NODE][NUM_NODE];
+
 Buddy::Buddy (mword phys, mword virt, mword f_addr, size_t size)
 : List<Buddy>(list)
 {
@@ -77,6 +86,16 @@ Buddy::Buddy (mword phys, mword virt, mword f_addr, size_t size)
 
     for (mword i = f_addr; i < virt + size; i += PAGE_SIZE)
         _free (i, Quota::init);
+
+    if (pools < pool_max) {
+
+        unsigned i = pools++;
+
+        for (; i && pool[i - 1]->index_to_page (pool[i - 1]->min_idx) > index_to_page (min_idx); i--)
+            pool[i] = pool[i - 1];
+
+        pool[i] = this;
+    }
 }
 
 /*
@@ -87,8 +106,28 @@ Buddy::Buddy (mword phys, mword virt, mword f_addr, size_t size)
  */
 void *Buddy::_alloc (unsigned short ord, Quota &quota, Fill fill)
 {
-    Lock_guard <Spinlock> guard (lock);
+    mword virt;
+
+    {   Lock_guard <Spinlock> guard (lock);
 
+        if (!(virt = take (ord)))
+            return nullptr;
+    }
+
+    if (fill)
+        memset (reinterpret_cast<void *>(virt), fill == FILL_0 ? 0 : -1, 1ul << (ord + PAGE_BITS));
+
+    quota.alloc(1ul << ord);
+
+    return reinterpret_cast<void *>(virt);
+}
+
+/*
+ * Remove a block from the block lists, the caller holds the lock.
+ * @return          Linear block base address, 0 if none is available
+ */
+mword Buddy::take (unsigned short ord)
+{
     for (unsigned short j = ord; j < order; j++) {
 
         if (head[j].next == head + j)
@@ -113,29 +152,245 @@ void *Buddy::_alloc (unsigned short ord, Quota &quota, Fill fill)
         // Ensure corresponding physical block is order-aligned
         assert ((virt_to_phys (virt) & ((1ul << (block->ord + PAGE_BITS)) - 1)) == 0);
 
-        if (fill)
-            memset (reinterpret_cast<void *>(virt), fill == FILL_0 ? 0 : -1, 1ul << (block->ord + PAGE_BITS));
+        return virt;
+    }
 
-        quota.alloc(1ul << ord);
+    return 0;
+}
+
+Buddy::Pcp *Buddy::pcp_local()
+{
+    if (!cpu_local() || Cpu::preemption)
+        return nullptr;
+
+    return pcp + Cpu::id;
+}
+
+bool Buddy::pcp_refill (Pcp &p)
+{
+    nearest ([&] (Buddy *b) -> void * {
+
+        Lock_guard <Spinlock> guard (b->lock);
+
+        for (mword virt; p.count < pcp_batch && (virt = b->take (0)); )
+            p.page[p.count++] = virt;
+
+        return p.count < pcp_batch ? nullptr : b;
+    });
 
-        return reinterpret_cast<void *>(virt);
+    return p.count;
+}
+
+void Buddy::pcp_drain (Pcp &p)
+{
+    mword *page = p.page + p.count - pcp_batch;
+
+    for (Buddy *b = list; b; b = b->next) {
+
+        Lock_guard <Spinlock> guard (b->lock);
+
+        for (unsigned i = 0; i < pcp_batch; i++)
+            if (page[i] && b->owns (page[i])) {
+                b->give (page[i]);
+                page[i] = 0;
+            }
     }
 
-    return nullptr;
+    p.count -= pcp_batch;
+}
+
+/*
+ * Return the cached pages of all CPUs to their pools.
+ * @return          true if any page was returned
+ */
+bool Buddy::pcp_reclaim()
+{
+    bool any = false;
+
+    for (unsigned c = 0; c < NUM_CPU; c++) {
+
+        Lock_guard <Spinlock> guard (pcp[c].lock);
+
+        for (unsigned long i = 0; i < pcp[c].count; i++, any = true) {
+
+            Buddy *b = owner (pcp[c].page[i]);
+
+            Lock_guard <Spinlock> guard_b (b->lock);
+
+            b->give (pcp[c].page[i]);
+        }
+
+        for (unsigned long i = 0; i < pcp[c].zeroed; i++, any = true) {
+
+            Buddy *b = owner (pcp[c].zero[i]);
+
+            Lock_guard <Spinlock> guard_b (b->lock);
+
+            b->give (pcp[c].zero[i]);
+        }
+
+        pcp[c].count = pcp[c].zeroed = 0;
+    }
+
+    return any;
+}
+
+/*
+ * Zero one page of the local cache with non-temporal stores and move it to
+ * the pre-zeroed list. Called from the idle EC with interrupts disabled.
+ * @return          true if a page was zeroed
+ */
+bool Buddy::prezero()
+{
+    Pcp *p = pcp_local();
+
+    if (!p)
+        return false;
+
+    mword virt;
+
+    {   Lock_guard <Spinlock> guard (p->lock);
+
+        if (p->zeroed == pcp_zero || (!p->count && !pcp_refill (*p)))
+            return false;
+
+        virt = p->page[--p->count];
+    }
+
+    uint64 t = rdtsc();
+
+    for (mword *w = reinterpret_cast<mword *>(virt), *e = w + PAGE_SIZE / sizeof (mword); w < e; w += 4)
+        asm volatile ("movnti %4, %0; movnti %4, %1; movnti %4, %2; movnti %4, %3"
+                      : "=m" (w[0]), "=m" (w[1]), "=m" (w[2]), "=m" (w[3]) : "r" (0UL));
+
+    asm volatile ("sfence" : : : "memory");
+
+    Counter::cycles_zero += rdtsc() - t;
+
+    Lock_guard <Spinlock> guard (p->lock);
+
+    p->zero[p->zeroed++] = virt;
+
+    return true;
 }
 
 void *Buddy::alloc (unsigned short ord, Quota &quota, Fill fill)
 {
-    for (Buddy *b = list; b; b = b->next) {
-        void * v = b->_alloc(ord, quota, fill);
-        if (v) return v;
+    Pcp *p;
+
+    if (!ord && (p = pcp_local())) {
+
+        mword virt = 0;
+
+        {   Lock_guard <Spinlock> guard (p->lock);
+
+            if (fill == FILL_0 && p->zeroed) {
+                virt = p->zero[--p->zeroed];
+                fill = NOFILL;
+                Counter::page_zero_hit++;
+            } else if (p->count || pcp_refill (*p)) {
+                virt = p->page[--p->count];
+                if (fill == FILL_0)
+                    Counter::page_zero_miss++;
+            } else if (p->zeroed)
+                virt = p->zero[--p->zeroed];
+        }
+
+        if (virt) {
+
+            if (fill)
+                memset (reinterpret_cast<void *>(virt), fill == FILL_0 ? 0 : -1, PAGE_SIZE);
+
+            quota.alloc(1);
+
+            Counter::page_pcp++;
+
+            return reinterpret_cast<void *>(virt);
+        }
     }
 
+    do
+        if (void *v = nearest ([&] (Buddy *b) { return b->_alloc (ord, quota, fill); }))
+            return v;
+    while (pcp_reclaim());
+
     quota.dump(Pd::current);
 
     Console::panic ("Out of memory");
 }
 
+/*
+ * NUMA node of the current CPU, 0 before it runs on its CPU-local stack.
+ */
+unsigned Buddy::home()
+{
+    return nodes && cpu_local() ? Cpu::node[Cpu::id] : 0;
+}
+
+/*
+ * Enable NUMA placement for n nodes, ordering remote nodes by number
+ * until a distance table is set.
+ */
+void Buddy::set_nodes (unsigned n)
+{
+    nodes = min (n, static_cast<unsigned>(NUM_NODE));
+
+    for (unsigned i = 0; i < nodes; i++) {
+
+        near[i][0] = static_cast<uint8>(i);
+
+        for (unsigned j = 0, k = 1; j < nodes; j++)
+            if (j != i)
+                near[i][k++] = static_cast<uint8>(j);
+    }
+}
+
+/*
+ * Assign each pool to a node.
+ * @param node_of   Node that holds most of a physical range
+ */
+void Buddy::set_node (unsigned (*node_of)(uint64, uint64))
+{
+    for (Buddy *b = list; b; b = b->next) {
+
+        uint64 p = b->virt_to_phys (b->index_to_page (b->min_idx));
+        uint64 s = static_cast<uint64>(b->max_idx - b->min_idx) * PAGE_SIZE;
+
+        b->node = node_of (p, s);
+
+        trace (TRACE_MEMORY, "POOL: %#010llx-%#010llx NODE:%u", p, p + s, b->node);
+    }
+}
+
+bool Buddy::has_node (unsigned n)
+{
+    for (Buddy *b = list; b; b = b->next)
+        if (b->node == n)
+            return true;
+
+    return false;
+}
+
+/*
+ * Order all nodes by increasing distance from node n.
+ * @param dist      Row n of the SLIT with cnt entries
+ */
+void Buddy::set_distance (unsigned n, uint8 const *dist, unsigned cnt)
+{
+    if (n >= nodes || cnt < nodes)
+        return;
+
+    uint8 *o = near[n];
+
+    for (unsigned i = 0; i < nodes; i++)
+        o[i] = static_cast<uint8>(i);
+
+    for (unsigned i = 1; i < nodes; i++)
+        for (unsigned j = i; j && dist[o[j]] < dist[o[j - 1]]; j--) {
+            uint8 t = o[j]; o[j] = o[j - 1]; o[j - 1] = t;
+        }
+}
+
 /*
  * Free physically contiguous memory region.
  * @param virt     Linear block base address
@@ -159,6 +414,16 @@ void Buddy::_free (mword virt, Quota &quota)
 
     Lock_guard <Spinlock> guard (lock);
 
+    give (virt);
+}
+
+/*
+ * Merge a used block back into the block lists, the caller holds the lock.
+ */
+void Buddy::give (mword virt)
+{
+    Block *block = index_to_block (page_to_index (virt));
+
     unsigned short ord;
     for (ord = block->ord; ord < order - 1; ord++) {
 
@@ -195,17 +460,63 @@ void Buddy::_free (mword virt, Quota &quota)
     block->next->prev = h->next = block;
 }
 
+/*
+ * Find the pool that owns a linear address.
+ * @return          Owning pool, nullptr if none
+ */
+Buddy *Buddy::owner (mword virt)
+{
+    unsigned lo = 0, hi = pools;
+
+    // Find the first pool that starts above virt
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (virt < pool[mid]->index_to_page (pool[mid]->min_idx))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    if (lo && pool[lo - 1]->owns (virt))
+        return pool[lo - 1];
+
+    if (EXPECT_FALSE (pools == pool_max))
+        for (Buddy *b = list; b; b = b->next)
+            if (b->owns (virt))
+                return b;
+
+    return nullptr;
+}
+
 void Buddy::free (mword virt, Quota &quota)
 {
-    for (Buddy *b = list; b; b = b->next) {
-        signed long idx = b->page_to_index (virt);
-        if (idx >= b->min_idx && idx < b->max_idx) {
-            b->_free(virt, quota);
-            return;
-        }
+    Buddy *b = owner (virt);
+
+    if (EXPECT_FALSE (!b))
+        Console::panic ("Invalid memory free");
+
+    Block *block = b->index_to_block (b->page_to_index (virt));
+    Pcp *p;
+
+    if (!block->ord && (p = pcp_local()) && b->node == home()) {
+
+        assert (block->tag == Block::Used);
+
+        quota.free(1);
+
+        Lock_guard <Spinlock> guard (p->lock);
+
+        if (p->count == pcp_max)
+            pcp_drain (*p);
+
+        p->page[p->count++] = virt;
+
+        Counter::page_pcp++;
+
+        return;
     }
 
-    Console::panic ("Invalid memory free");
+    b->_free(virt, quota);
 }
 
 void Quota::dump(void * pd, bool all)
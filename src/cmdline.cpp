@@ -35,6 +35,12 @@ bool Cmdline::novga;
 bool Cmdline::novpid;
 bool Cmdline::logmem;
 bool Cmdline::fpu_lazy;
+bool Cmdline::balance;
+bool Cmdline::sctrace;
+bool Cmdline::haltpoll;
+bool Cmdline::nomwait;
+bool Cmdline::edf;
+bool Cmdline::selftest;
 
 struct Cmdline::param_map Cmdline::map[] INITDATA =
 {
@@ -49,6 +55,12 @@ struct Cmdline::param_map Cmdline::map[] INITDATA =
     { "novpid",     &Cmdline::novpid    },
     { "logmem",     &Cmdline::logmem    },
     { "fpu_lazy",   &Cmdline::fpu_lazy  },
+    { "balance",    &Cmdline::balance   },
+    { "sctrace",    &Cmdline::sctrace   },
+    { "haltpoll",   &Cmdline::haltpoll  },
+    { "nomwait",    &Cmdline::nomwait   },
+    { "edf",        &Cmdline::edf       },
+    { "selftest",   &Cmdline::selftest  },
 };
 
 char const *Cmdline::get_arg (char const **line, unsigned &len)
@@ -33,20 +33,48 @@ unsigned    Counter::vtlb_fill;
 unsigned    Counter::vtlb_flush;
 unsigned    Counter::schedule;
 unsigned    Counter::helping;
+unsigned    Counter::help_saved;
+unsigned    Counter::rrq_retry;
+unsigned    Counter::rrq_coalesced;
+unsigned    Counter::rrq_mwait;
+unsigned    Counter::timer_set;
+unsigned    Counter::timer_skip;
+unsigned    Counter::steal;
+unsigned    Counter::slab_mag;
+unsigned    Counter::page_pcp;
+unsigned    Counter::page_zero_hit;
+unsigned    Counter::page_zero_miss;
 uint64      Counter::cycles_idle;
+uint64      Counter::cycles_poll;
+uint64      Counter::cycles_zero;
 
 void Counter::dump()
 {
     trace (0, "TIME: %16llu", rdtsc());
     trace (0, "IDLE: %16llu", Counter::cycles_idle);
+    trace (0, "POLL: %16llu", Counter::cycles_poll);
+    trace (0, "ZERO: %16llu", Counter::cycles_zero);
     trace (0, "VGPF: %16u", Counter::vtlb_gpf);
     trace (0, "VHPF: %16u", Counter::vtlb_hpf);
     trace (0, "VFIL: %16u", Counter::vtlb_fill);
     trace (0, "VFLU: %16u", Counter::vtlb_flush);
     trace (0, "SCHD: %16u", Counter::schedule);
     trace (0, "HELP: %16u", Counter::helping);
+    trace (0, "HLPS: %16u", Counter::help_saved);
+    trace (0, "RRQR: %16u", Counter::rrq_retry);
+    trace (0, "RRQC: %16u", Counter::rrq_coalesced);
+    trace (0, "RRQM: %16u", Counter::rrq_mwait);
+    trace (0, "TSET: %16u", Counter::timer_set);
+    trace (0, "TSKP: %16u", Counter::timer_skip);
+    trace (0, "STEA: %16u", Counter::steal);
+    trace (0, "SMAG: %16u", Counter::slab_mag);
+    trace (0, "PPCP: %16u", Counter::page_pcp);
+    trace (0, "PZHT: %16u", Counter::page_zero_hit);
+    trace (0, "PZMS: %16u", Counter::page_zero_miss);
 
-    Counter::vtlb_gpf = Counter::vtlb_hpf = Counter::vtlb_fill = Counter::vtlb_flush = Counter::schedule = Counter::helping = 0;
+    Counter::vtlb_gpf = Counter::vtlb_hpf = Counter::vtlb_fill = Counter::vtlb_flush = Counter::schedule = Counter::helping = Counter::help_saved = 0;
+    Counter::rrq_retry = Counter::rrq_coalesced = Counter::rrq_mwait = Counter::timer_set = Counter::timer_skip = Counter::steal = Counter::slab_mag = Counter::page_pcp = 0;
+    Counter::page_zero_hit = Counter::page_zero_miss = 0;
 
     for (unsigned i = 0; i < sizeof (Counter::ipi) / sizeof (*Counter::ipi); i++)
         if (Counter::ipi[i]) {
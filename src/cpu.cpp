@@ -54,6 +54,7 @@ unsigned    Cpu::hazard;
 uint8       Cpu::package[NUM_CPU];
 uint8       Cpu::core[NUM_CPU];
 uint8       Cpu::thread[NUM_CPU];
+uint8       Cpu::node[NUM_CPU];
 
 Cpu::Vendor Cpu::vendor;
 uint8       Cpu::platform[NUM_CPU];
@@ -63,6 +64,7 @@ uint8       Cpu::stepping[NUM_CPU];
 uint8       Cpu::core_type[NUM_CPU];
 unsigned    Cpu::brand;
 unsigned    Cpu::patch[NUM_CPU];
+uint8       Cpu::mwait_hint[NUM_CPU];
 unsigned    Cpu::row;
 
 uint32      Cpu::name[12];
@@ -232,6 +234,32 @@ void Cpu::setup_pcid()
     set_cr4 (get_cr4() | Cpu::CR4_PCIDE);
 }
 
+/*
+ * Select the deepest C-state that CPUID leaf 5 reports MWAIT sub-states
+ * for. The hint encodes the target C-state minus one in bits 7:4.
+ */
+void Cpu::setup_mwait()
+{
+    if (EXPECT_FALSE (Cmdline::nomwait))
+        defeature (FEAT_MONITOR);
+
+    if (EXPECT_FALSE (!feature (FEAT_MONITOR)))
+        return;
+
+    uint32 eax, ebx, ecx, edx;
+    cpuid (5, eax, ebx, ecx, edx);
+
+    mwait_hint[id] = 0;
+
+    // Without an always-running APIC timer, C-states beyond C1 lose timeouts
+    if (!feature (FEAT_ARAT))
+        return;
+
+    for (unsigned c = 2; c < 8; c++)
+        if (edx >> c * 4 & 0xf)
+            mwait_hint[id] = static_cast<uint8>((c - 1) << 4);
+}
+
 void Cpu::init(bool resume)
 {
     if (!resume)
@@ -289,6 +317,8 @@ void Cpu::init(bool resume)
 
     setup_pcid();
 
+    setup_mwait();
+
     mword cr4 = get_cr4();
     if (EXPECT_TRUE (feature (FEAT_SMEP)))
         cr4 |= Cpu::CR4_SMEP;
@@ -37,6 +37,8 @@ Sm *Ec::auth_suspend;
 
 uint64 Ec::killed_time[NUM_CPU];
 
+unsigned Ec::poll_window;
+
 // Constructors
 Ec::Ec (Pd *own, void (*f)(), unsigned c) : Kobject (EC, static_cast<Space_obj *>(own)), cont (f), pd (own), partner (nullptr), prev (nullptr), next (nullptr), fpu (nullptr), cpu (static_cast<uint16>(c)), glb (true), evt (0), timeout (this), user_utcb (0), xcpu_sm (nullptr), pt_oom(nullptr)
 {
@@ -47,7 +49,7 @@ Ec::Ec (Pd *own, void (*f)(), unsigned c) : Kobject (EC, static_cast<Space_obj *
     regs.vmcb_state = nullptr;
 }
 
-Ec::Ec (Pd *own, mword sel, Pd *p, void (*f)(), unsigned c, unsigned e, mword u, mword s, Pt *oom) : Kobject (EC, static_cast<Space_obj *>(own), sel, 0xd, free, pre_free), cont (f), pd (p), partner (nullptr), prev (nullptr), next (nullptr), fpu (nullptr), cpu (static_cast<uint16>(c)), glb (!!f), evt (e), timeout (this), user_utcb (u), xcpu_sm (nullptr), pt_oom (oom)
+Ec::Ec (Pd *own, mword sel, Pd *p, void (*f)(), unsigned c, unsigned e, mword u, mword s, Pt *oom, unsigned o) : Kobject (EC, static_cast<Space_obj *>(own), sel, 0xd, free, pre_free), cont (f), pd (p), partner (nullptr), prev (nullptr), next (nullptr), fpu (nullptr), cpu (static_cast<uint16>(c)), glb (!!f), evt (e), timeout (this), user_utcb (u), utcb_order (o), xcpu_sm (nullptr), pt_oom (oom)
 {
     // Make sure we have a PTAB for this CPU in the PD
     pd->Space_mem::init (pd->quota, c);
@@ -72,16 +74,16 @@ Ec::Ec (Pd *own, mword sel, Pd *p, void (*f)(), unsigned c, unsigned e, mword u,
         else
             regs.set_sp (s);
 
-        utcb = new (pd->quota) Utcb;
+        utcb = new (pd->quota, o) Utcb;
 
-        pd->Space_mem::insert (pd->quota, u, 0, Hpt::HPT_U | Hpt::HPT_W | Hpt::HPT_P, Buddy::ptr_to_phys (utcb));
+        pd->Space_mem::insert (pd->quota, u, o, Hpt::HPT_U | Hpt::HPT_W | Hpt::HPT_P, Buddy::ptr_to_phys (utcb));
 
         regs.dst_portal = PT_STARTUP;
 
         trace (TRACE_SYSCALL, "EC:%p created (PD:%p CPU:%#x UTCB:%#lx ESP:%lx EVT:%#x)", this, p, c, u, s, e);
 
         if (pd == &Pd::root)
-            pd->insert_utcb (pd->quota, pd->mdb_cache, u, Buddy::ptr_to_phys(utcb) >> 12);
+            pd->insert_utcb (pd->quota, pd->mdb_cache, u, Buddy::ptr_to_phys(utcb) >> 12, o);
 
     } else {
 
@@ -141,7 +143,7 @@ Ec::Ec (Pd *own, mword sel, Pd *p, void (*f)(), unsigned c, unsigned e, mword u,
     }
 }
 
-Ec::Ec (Pd *own, Pd *p, void (*f)(), unsigned c, Ec *clone) : Kobject (EC, static_cast<Space_obj *>(own), 0, 0xd, free, pre_free), cont (f), regs (clone->regs), rcap (clone), utcb (clone->utcb), pd (p), partner (nullptr), prev (nullptr), next (nullptr), fpu (clone->fpu), cpu (static_cast<uint16>(c)), glb (!!f), evt (clone->evt), timeout (this), user_utcb (0), xcpu_sm (clone->xcpu_sm), pt_oom(clone->pt_oom)
+Ec::Ec (Pd *own, Pd *p, void (*f)(), unsigned c, Ec *clone) : Kobject (EC, static_cast<Space_obj *>(own), 0, 0xd, free, pre_free), cont (f), regs (clone->regs), rcap (clone), utcb (clone->utcb), pd (p), partner (nullptr), prev (nullptr), next (nullptr), fpu (clone->fpu), cpu (static_cast<uint16>(c)), glb (!!f), evt (clone->evt), timeout (this), user_utcb (0), utcb_order (clone->utcb_order), xcpu_sm (clone->xcpu_sm), pt_oom(clone->pt_oom)
 {
     // Make sure we have a PTAB for this CPU in the PD
     pd->Space_mem::init (pd->quota, c);
@@ -154,7 +156,7 @@ Ec::Ec (Pd *own, Pd *p, void (*f)(), unsigned c, Ec *clone) : Kobject (EC, stati
         pt_oom = nullptr;
 }
 
-Ec::Ec (Pd *own, Pd *p, void (*f)(), unsigned c, Ec *clone, Pt *pt) : Kobject (EC, static_cast<Space_obj *>(own), clone->node_base, 0xd, free, pre_free), cont (f), regs (clone->regs), rcap (nullptr), utcb (clone->utcb), pd (p), partner (nullptr), prev (nullptr), next (nullptr), fpu (clone->fpu), cpu (static_cast<uint16>(c)), glb (!!f), evt (clone->evt), timeout (this), user_utcb (clone->user_utcb), xcpu_sm (clone->xcpu_sm), pt_oom(pt)
+Ec::Ec (Pd *own, Pd *p, void (*f)(), unsigned c, Ec *clone, Pt *pt) : Kobject (EC, static_cast<Space_obj *>(own), clone->node_base, 0xd, free, pre_free), cont (f), regs (clone->regs), rcap (nullptr), utcb (clone->utcb), pd (p), partner (nullptr), prev (nullptr), next (nullptr), fpu (clone->fpu), cpu (static_cast<uint16>(c)), glb (!!f), evt (clone->evt), timeout (this), user_utcb (clone->user_utcb), utcb_order (clone->utcb_order), xcpu_sm (clone->xcpu_sm), pt_oom(pt)
 {
     if (EXPECT_FALSE((fpowner == clone) && clone->fpu && Cmdline::fpu_lazy)) {
         Fpu::enable();
@@ -418,12 +420,74 @@ void Ec::idle()
         if (EXPECT_FALSE (hzd))
             handle_hazard (hzd, idle);
 
+        if (Cmdline::balance)
+            Sc::steal();
+
+        if (Buddy::prezero()) {
+            Cpu::preemption_point();
+            continue;
+        }
+
         uint64 t1 = rdtsc();
-        asm volatile ("sti; hlt; cli" : : : "memory");
+
+        if (Cmdline::haltpoll && idle_poll (t1))
+            continue;
+
         uint64 t2 = rdtsc();
 
-        Counter::cycles_idle += t2 - t1;
+        if (Cpu::feature (Cpu::FEAT_MONITOR))
+            Sc::mwait (Timeout::earliest() > t2 && Timeout::earliest() - t2 > Lapic::freq_tsc ? Cpu::mwait_hint[Cpu::id] : 0);
+        else
+            asm volatile ("sti; hlt; cli" : : : "memory");
+
+        uint64 t3 = rdtsc();
+
+        Counter::cycles_idle += t3 - t2;
+
+        if (!Cmdline::haltpoll)
+            continue;
+
+        uint64 const poll_max = Lapic::freq_tsc / 1000 * poll_max_us;
+
+        if (t3 - t1 <= poll_max)
+            poll_window = static_cast<unsigned>(poll_window ? min<uint64> (poll_window * 2ULL, poll_max) : poll_max / 16);
+        else
+            poll_window /= 2;
+    }
+}
+
+/*
+ * Spin until the local remote run queue or a hazard indicates work, or the
+ * poll window expires. Interrupts are taken at each preemption point.
+ */
+bool Ec::idle_poll (uint64 t1)
+{
+    uint64 t2 = t1;
+    bool work = false;
+
+    for (; t2 - t1 < poll_window; t2 = rdtsc()) {
+
+        if (Sc::rq_pending())
+            Sc::rrq_handler();
+
+        if ((work = Cpu::hazard & (HZD_RCU | HZD_SCHED | HZD_TSC_AUX)))
+            break;
+
+        Cpu::preemption_point();
+        pause();
+    }
+
+    // An interrupt taken at the last preemption point may have posted work
+    if (!work) {
+        if (Sc::rq_pending())
+            Sc::rrq_handler();
+
+        work = Cpu::hazard & (HZD_RCU | HZD_SCHED | HZD_TSC_AUX);
     }
+
+    Counter::cycles_poll += t2 - t1;
+
+    return work;
 }
 
 void Ec::root_invoke()
@@ -548,6 +612,19 @@ void Ec::xcpu_return()
     *current->rcap->exc_regs() = current->regs;
     current->rcap->regs.mtd = current->regs.mtd;
 
+    // An FPU context saved for the clone itself is of no further use
+    if (current->fpu && current->fpu != current->rcap->fpu)
+        Fpu::destroy (current->fpu, *current->pd);
+
+    // Drop FPU ownership so that a reused clone loads the state of its caller
+    if (fpowner == current) {
+        bool zero = fpowner->del_ref();
+        assert (!zero);
+
+        fpowner = nullptr;
+        Fpu::disable();
+    }
+
     current->xcpu_sm->up (ret_xcpu_reply);
 
     current->rcap    = nullptr;
@@ -555,12 +632,56 @@ void Ec::xcpu_return()
     current->fpu     = nullptr;
     current->xcpu_sm = nullptr;
 
-    Rcu::call(current);
-    Rcu::call(Sc::current);
+    Sc::xcpu_park = Sc::current;
 
     Sc::schedule(true);
 }
 
+/*
+ * Clones for xCPU calls are recycled through a per-PD pool with one idle
+ * clone per CPU. A clone enters the pool once its CPU has switched away
+ * from it (see Sc::park) and is reused if it matches the caller in event
+ * base, OOM portal, priority and budget. Pooled clones stay charged to the
+ * quota of the PD.
+ */
+Sc *Ec::xcpu_clone (unsigned c)
+{
+    Sc *sc = Pd::current->xcpu_take (c);
+
+    if (sc) {
+        Ec *ec = sc->ec;
+
+        if (ec->evt == current->evt && ec->pt_oom == current->pt_oom &&
+            sc->prio == Sc::current->prio && sc->budget == Sc::current->budget) {
+
+            ec->cont       = sys_call;
+            ec->regs       = current->regs;
+            ec->rcap       = current;
+            ec->utcb       = current->utcb;
+            ec->utcb_order = current->utcb_order;
+            ec->fpu        = current->fpu;
+            ec->xcpu_sm    = current->xcpu_sm;
+
+            ec->regs.vtlb = nullptr;
+            ec->regs.vmcs_state = nullptr;
+            ec->regs.vmcb_state = nullptr;
+
+            sc->xcpu_reuse (Sc::current);
+
+            return sc;
+        }
+
+        if (!Pd::current->xcpu_give (sc)) {
+            Rcu::call (ec);
+            Rcu::call (sc);
+        }
+    }
+
+    Ec *xcpu_ec = new (*Pd::current) Ec (Pd::current, Pd::current, sys_call, c, current);
+
+    return new (*xcpu_ec->pd) Sc (Pd::current, xcpu_ec, xcpu_ec->cpu, Sc::current);
+}
+
 void Ec::idl_handler()
 {
     if (Ec::current->cont == Ec::idle)
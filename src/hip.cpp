@@ -29,8 +29,11 @@
 #include "space_obj.hpp"
 #include "pd.hpp"
 #include "acpi_rsdp.hpp"
+#include "acpi_srat.hpp"
 #include "acpi.hpp"
 #include "string.hpp"
+#include "utcb.hpp"
+#include "sc_trace.hpp"
 
 extern char _mempool_e;
 
@@ -65,6 +68,7 @@ void Hip::build (mword magic, mword addr)
     h->sel_vmi    = NUM_VMI;
     h->cfg_page   = PAGE_SIZE;
     h->cfg_utcb   = PAGE_SIZE;
+    h->cfg_utcb_max = PAGE_SIZE << Utcb::order_max;
 
     Hip_mem *mem = h->mem_desc;
 
@@ -272,6 +276,42 @@ void Hip::add_check()
         mem++;
     }
 
+    if (Sc_trace::enabled()) {
+        mem->addr = Sc_trace::phys();
+        mem->size = Sc_trace::bytes();
+        mem->type = Hip_mem::SC_TRACE;
+        mem->aux  = 0;
+        mem++;
+    }
+
+    for (unsigned i = 0; i < Acpi_table_srat::count; i++) {
+        mem->addr = Acpi_table_srat::range[i].base;
+        mem->size = Acpi_table_srat::range[i].size;
+        mem->type = Hip_mem::NUMA_MEM;
+        mem->aux  = Acpi_table_srat::range[i].node;
+        mem++;
+    }
+
+    static_assert (NUM_CPU <= 64, "NUMA_CPU mask too small");
+
+    for (unsigned n = 0; Acpi_table_srat::count && n < NUM_NODE; n++) {
+
+        uint64 cpus = 0;
+
+        for (unsigned i = 0; i < NUM_CPU; i++)
+            if (cpu_online (i) && Cpu::node[i] == n)
+                cpus |= 1ULL << i;
+
+        if (!cpus)
+            continue;
+
+        mem->addr = cpus;
+        mem->size = 0;
+        mem->type = Hip_mem::NUMA_CPU;
+        mem->aux  = n;
+        mem++;
+    }
+
     h->length = static_cast<uint16>(reinterpret_cast<mword>(mem) - reinterpret_cast<mword>(h));
 
     h->freq_tsc = Lapic::freq_tsc;
@@ -318,12 +358,12 @@ void Hip::add_buddy (Hip_mem *&mem, Hip * hip, uint64 const system_mem_max,
 }
 
 void Hip::_add_buddy (Hip_mem *&mem, Hip * hip, uint64 const system_mem_max,
-                      uint64 &memory_allocated, Hip_mem const &cmp)
+                      uint64 &memory_allocated, Hip_mem const &cmp, uint64 start)
 {
     enum { MEMORY_AVAIL = 1 };
 
     mword const mhv_end = reinterpret_cast<mword>(&LINK_E);
-    uint64 region_start = mhv_end;
+    uint64 region_start = max<uint64> (mhv_end, start);
     uint64 region_end   = cmp.addr + cmp.size;
 
     if (region_end <= region_start)
@@ -409,3 +449,53 @@ void Hip::_add_buddy (Hip_mem *&mem, Hip * hip, uint64 const system_mem_max,
 
     memory_allocated += buddy_size;
 }
+
+/*
+ * Add a pool from the available memory of a NUMA node, sized like the boot
+ * pools relative to the memory of the node. Only memory that fits into the
+ * linear buddy window behind the hypervisor can be used.
+ * @return          true if a pool was added
+ */
+bool Hip::add_node_buddy (unsigned node)
+{
+    Hip *h = hip();
+    Hip_mem *mem = reinterpret_cast<Hip_mem *>(reinterpret_cast<mword>(h) + h->length);
+
+    uint64 node_mem = 0, allocated = 0;
+
+    auto each = [&] (auto fn) {
+        for (unsigned i = 0; i < Acpi_table_srat::count; i++) {
+
+            Acpi_table_srat::Range const &r = Acpi_table_srat::range[i];
+
+            if (r.node != node)
+                continue;
+
+            for_each (*h, [&] (Hip_mem &m) {
+                if (m.type != MEMORY_AVAIL)
+                    return;
+
+                uint64 s = max (m.addr, r.base);
+                uint64 e = min (m.addr + m.size, r.base + r.size);
+
+                if (e > s)
+                    fn (s, e);
+            });
+        }
+    };
+
+    each ([&] (uint64 s, uint64 e) { node_mem += e - s; });
+
+    each ([&] (uint64 s, uint64 e) {
+        if (allocated)
+            return;
+
+        Hip_mem cmp { s, e - s, MEMORY_AVAIL, 0 };
+
+        _add_buddy (mem, h, node_mem, allocated, cmp, s);
+    });
+
+    h->length = static_cast<uint16>(reinterpret_cast<mword>(mem) - reinterpret_cast<mword>(h));
+
+    return allocated;
+}
@@ -45,8 +45,8 @@ void Ec::oom_delegate(Ec * dst_ec, Ec * rep_ec, Ec * src_ec, bool user, bool C)
         assert(!C);
         assert(src_ec->utcb);
 
-        Xfer *s = src_ec->utcb->xfer();
-        for (unsigned long ti = src_ec->utcb->ti(); ti--; s--) {
+        Xfer *s = src_ec->utcb->xfer (src_ec->utcb_order);
+        for (unsigned long ti = src_ec->utcb->ti (src_ec->utcb_order); ti--; s--) {
             if ((s->flags() >> 8) & 1)
                 continue;
             src_ec->pd->rev_crd (*s, false, false, false);
@@ -345,6 +345,48 @@ void Pd::del_crd (Pd *pd, Crd del, Crd &crd, mword sub, mword hot)
         shootdown(this);
 }
 
+/*
+ * Move a memory mapping: delegate it and remove it from the sender in one
+ * step. The item must cover exactly one delegated node of the sender that
+ * has no children. The sender node is then dropped with the keep-in-mdb
+ * revoke, which leaves the new node of the receiver attached to the parent
+ * of the sender.
+ */
+void Pd::mov_crd (Pd *pd, Crd del, Crd &crd, mword sub, mword hot)
+{
+    mword sb = crd.base(), rb = del.base(), o;
+
+    if (EXPECT_FALSE (crd.type() != Crd::MEM || del.type() != Crd::MEM)) {
+        crd = Crd (0);
+        return;
+    }
+
+    o = clamp (sb, rb, crd.order(), del.order(), hot);
+
+    Mdb *mdb = pd->Space_mem::tree_lookup (sb);
+
+    if (!mdb || !mdb->prnt || mdb->node_base != sb || mdb->node_order != o || ACCESS_ONCE (mdb->next)->dpth > mdb->dpth) {
+        crd = Crd (0);
+        return;
+    }
+
+    del_crd (pd, del, crd, sub, hot);
+
+    if (Cpu::hazard & HZD_OOM)
+        return;
+
+    Mdb *node = ACCESS_ONCE (mdb->next);
+
+    if (!crd.type() || node->dpth <= mdb->dpth || node->space != static_cast<Space_mem *>(this)) {
+        crd = Crd (0);
+        return;
+    }
+
+    trace (TRACE_DEL, "MOV MEM PD:%p->%p SB:%#010lx RB:%#010lx O:%#04lx", pd, this, sb, crd.base(), o);
+
+    pd->rev_crd (Crd (Crd::MEM, sb, o, 0x1f), true, false, true);
+}
+
 void Pd::rev_crd (Crd crd, bool self, bool preempt, bool kim)
 {
     if (preempt)
@@ -411,9 +453,11 @@ void Pd::xfer_items (Pd *src, Crd xlt, Crd del, Xfer *s, Xfer *d, unsigned long
                     return;
                 break;
             }
-            default:
-                crd = Crd(0);
-
+            case 3:
+                mov_crd (src, del, crd, (s->flags() >> 8) & 3, s->hotspot());
+                if (Cpu::hazard & HZD_OOM)
+                    return;
+                break;
         };
 
         if (d)
@@ -449,6 +493,34 @@ void Pd::assign_rid(uint16 const r)
     rids_u     |= static_cast<uint16>(1U << free);
 }
 
+Sc *Pd::xcpu_take (unsigned c)
+{
+    Sc *sc = ACCESS_ONCE (xcpu_pool[c]);
+
+    if (!sc || sc == xcpu_closed() || !Atomic::cmp_swap (xcpu_pool[c], sc, static_cast<Sc *>(nullptr)))
+        return nullptr;
+
+    return sc;
+}
+
+bool Pd::xcpu_give (Sc *sc)
+{
+    return Atomic::cmp_swap (xcpu_pool[sc->cpu], static_cast<Sc *>(nullptr), sc);
+}
+
+void Pd::xcpu_drain()
+{
+    for (unsigned c = 0; c < NUM_CPU; c++) {
+        Sc *sc = Atomic::exchange (xcpu_pool[c], xcpu_closed());
+
+        if (!sc || sc == xcpu_closed())
+            continue;
+
+        Rcu::call (sc->ec);
+        Rcu::call (sc);
+    }
+}
+
 Pd::~Pd()
 {
     pre_free(this);
@@ -21,6 +21,7 @@
  */
 
 #include "ec.hpp"
+#include "hip.hpp"
 #include "lapic.hpp"
 #include "stdio.hpp"
 #include "timeout_budget.hpp"
@@ -33,30 +34,89 @@ Sc *        Sc::current;
 unsigned    Sc::ctr_link;
 unsigned    Sc::ctr_loop;
 uint64      Sc::long_loop;
+Sc *        Sc::xcpu_park;
 uint64      Sc::cross_time[NUM_CPU];
+mword       Sc::chain_reply[NUM_CPU];
 uint64      Sc::killed_time[NUM_CPU];
 
 Sc *Sc::list[Sc::priorities];
 
-unsigned Sc::prio_top;
+mword Sc::prio_map[Sc::priorities / Sc::prio_word];
+mword Sc::prio_idx;
 
-Sc::Sc (Pd *own, mword sel, Ec *e) : Kobject (SC, static_cast<Space_obj *>(own), sel, 0x1, free), ec (e), cpu (static_cast<unsigned>(sel)), prio (0), budget (Lapic::freq_tsc * 1000), left (0)
+unsigned Sc::ready_mig[NUM_CPU];
+unsigned Sc::steal_req[NUM_CPU];
+uint64   Sc::steal_fail[NUM_CPU];
+
+unsigned Sc::edf_util[NUM_CPU];
+
+Sc::Sc (Pd *own, mword sel, Ec *e) : Kobject (SC, static_cast<Space_obj *>(own), sel, 0x1, free), ec (e), cpu (static_cast<unsigned>(sel)), prio (0), budget (Lapic::freq_tsc * 1000), migratable (false), period (0), util (0), left (0)
 {
     trace (TRACE_SYSCALL, "SC:%p created (PD:%p Kernel)", this, own);
 }
 
-Sc::Sc (Pd *own, mword sel, Ec *e, unsigned c, unsigned p, unsigned q) : Kobject (SC, static_cast<Space_obj *>(own), sel, 0x1, free, pre_free), ec (e), cpu (c), prio (static_cast<uint16>(p)), budget (Lapic::freq_tsc / 1000 * q), left (0)
+Sc::Sc (Pd *own, mword sel, Ec *e, unsigned c, unsigned p, unsigned q, bool m, unsigned t) : Kobject (SC, static_cast<Space_obj *>(own), sel, 0x1, free, pre_free), ec (e), cpu (c), prio (static_cast<uint16>(p)), budget (Lapic::freq_tsc / 1000 * q), migratable (m), period (static_cast<uint64>(Lapic::freq_tsc / 1000) * t), util (edf() ? edf_share (q, t) : 0), left (0)
 {
-    trace (TRACE_SYSCALL, "SC:%p created (EC:%p CPU:%#x P:%#x Q:%#x)", this, e, c, p, q);
+    trace (TRACE_SYSCALL, "SC:%p created (EC:%p CPU:%#x P:%#x Q:%#x T:%#x%s)", this, e, c, p, q, t, m ? " migratable" : "");
+
+    slot = Sc_trace::alloc (sel, c, p);
 }
 
-Sc::Sc (Pd *own, Ec *e, unsigned c, Sc *x) : Kobject (SC, static_cast<Space_obj *>(own), 0, 0x1, free_x), ec (e), cpu (c), prio (x->prio), budget (x->budget), left (x->left)
+Sc::Sc (Pd *own, Ec *e, unsigned c, Sc *x) : Kobject (SC, static_cast<Space_obj *>(own), 0, 0x1, free_x), ec (e), cpu (c), prio (x->prio), budget (x->budget), migratable (false), period (0), util (0), left (x->left), deadline (x->deadline)
 {
     trace (TRACE_SYSCALL, "SC:%p created (EC:%p CPU:%#x P:%#x Q:%#llx) - xCPU", this, e, c, prio, budget / (Lapic::freq_bus / 1000));
 }
 
-Sc::Sc (Pd *own, Ec *e, Sc &s) : Kobject (SC, static_cast<Space_obj *>(own), s.node_base, 0x1, free, pre_free), ec (e), cpu (e->cpu), prio (s.prio), disable (s.disable), budget (s.budget), time (s.time), time_m (s.time_m), left (s.left)
-{ }
+Sc::Sc (Pd *own, Ec *e, Sc &s) : Kobject (SC, static_cast<Space_obj *>(own), s.node_base, 0x1, free, pre_free), ec (e), cpu (e->cpu), prio (s.prio), disable (s.disable), budget (s.budget), time (s.time), time_m (s.time_m), migratable (s.migratable), bound (s.bound && e->bind_sc (s.migratable)), period (s.period), period_start (s.period_start), depleted (s.depleted), util (s.util), left (s.left)
+{
+    slot = Sc_trace::alloc (s.node_base, cpu, prio);
+}
+
+Sc::~Sc()
+{
+    if (bound)
+        ec->unbind_sc (migratable);
+
+    if (util)
+        Atomic::sub (edf_util[cpu], util);
+
+    Sc_trace::free (slot);
+}
+
+/*
+ * Utilisation-based admission: the EDF reservations of a CPU must not
+ * exceed its capacity.
+ */
+bool Sc::edf_admit (unsigned c, unsigned u)
+{
+    for (unsigned o;;) {
+        o = ACCESS_ONCE (edf_util[c]);
+
+        if (o + u > edf_max)
+            return false;
+
+        if (Atomic::cmp_swap (edf_util[c], o, o + u))
+            return true;
+    }
+}
+
+/*
+ * Keep the EDF band sorted by deadline with the earliest at list[prio].
+ * Equal deadlines are served in FIFO order.
+ */
+void Sc::edf_insert()
+{
+    Sc *s = list[prio];
+
+    while (s->deadline <= deadline && (s = s->next) != list[prio]) ;
+
+    next = s;
+    prev = s->prev;
+    next->prev = prev->next = this;
+
+    if (s == list[prio] && deadline < s->deadline)
+        list[prio] = this;
+}
 
 void Sc::ready_enqueue (uint64 t, bool inc_ref, bool use_left)
 {
@@ -70,11 +130,33 @@ void Sc::ready_enqueue (uint64 t, bool inc_ref, bool use_left)
             return;
     }
 
-    if (prio > prio_top)
-        prio_top = prio;
+    if (EXPECT_FALSE (period)) {
 
-    if (!list[prio])
+        assert (!replenish.active());
+
+        if (t - period_start >= period) {
+            period_start = t;
+            left = budget;
+        }
+
+        /* depleted - the timeout keeps the reference until replenished */
+        if (!left) {
+            depleted++;
+            Sc_trace::event (Sc_trace::DEPLETED, slot, prio, t);
+            trace (TRACE_SCHEDULE, "DPL:%p PRIO:%#x", this, prio);
+            replenish.enqueue (period_start + period);
+            return;
+        }
+    }
+
+    if (EXPECT_FALSE (edf()) && period)
+        deadline = period_start + period;
+
+    if (!list[prio]) {
         list[prio] = prev = next = this;
+        prio_set (prio);
+    } else if (EXPECT_FALSE (edf()))
+        edf_insert();
     else {
         next = list[prio];
         prev = list[prio]->prev;
@@ -83,14 +165,19 @@ void Sc::ready_enqueue (uint64 t, bool inc_ref, bool use_left)
             list[prio] = this;
     }
 
-    trace (TRACE_SCHEDULE, "ENQ:%p (%llu) PRIO:%#x TOP:%#x %s", this, left, prio, prio_top, prio > current->prio ? "reschedule" : "");
+    trace (TRACE_SCHEDULE, "ENQ:%p (%llu) PRIO:%#x TOP:%#x %s", this, left, prio, prio_top(), prio > current->prio ? "reschedule" : "");
 
-    if (prio > current->prio || (this != current && prio == current->prio && (use_left && left)))
+    if (prio > current->prio || (this != current && prio == current->prio && (edf() ? deadline < current->deadline : use_left && left)))
         Cpu::hazard |= HZD_SCHED;
 
     if (!left)
         left = budget;
 
+    if (migratable)
+        ready_mig[cpu]++;
+
+    Sc_trace::event (Sc_trace::ENQUEUE, slot, prio, t);
+
     tsc = t;
 }
 
@@ -100,17 +187,19 @@ void Sc::ready_dequeue (uint64 t)
     assert (cpu == Cpu::id);
     assert (prev && next);
 
-    if (list[prio] == this)
-        list[prio] = next == this ? nullptr : next;
+    if (list[prio] == this && !(list[prio] = next == this ? nullptr : next))
+        prio_clr (prio);
 
     next->prev = prev;
     prev->next = next;
     prev = next = nullptr;
 
-    while (!list[prio_top] && prio_top)
-        prio_top--;
+    if (migratable)
+        ready_mig[cpu]--;
+
+    Sc_trace::event (Sc_trace::DEQUEUE, slot, prio, t);
 
-    trace (TRACE_SCHEDULE, "DEQ:%p (%llu) PRIO:%#x TOP:%#x", this, left, prio, prio_top);
+    trace (TRACE_SCHEDULE, "DEQ:%p (%llu) PRIO:%#x TOP:%#x", this, left, prio, prio_top());
 
     ec->add_tsc_offset (tsc - t);
 
@@ -142,7 +231,7 @@ void Sc::schedule (bool suspend, bool use_left)
             if (current->del_rcu())
                 Rcu::call (current);
 
-        Sc *sc = list[prio_top];
+        Sc *sc = list[prio_top()];
         assert (sc);
 
         Timeout_budget::budget.enqueue (t + sc->left);
@@ -151,13 +240,69 @@ void Sc::schedule (bool suspend, bool use_left)
 
         current = sc;
         current->ready_dequeue (t);
+
+        Sc_trace::event (Sc_trace::SWITCH, current->slot, current->prio, t);
+
+        if (EXPECT_FALSE (current->wake)) {
+            Sc_trace::latency (current->slot, t - current->wake);
+            current->wake = 0;
+        }
     } while (EXPECT_FALSE(current->disable) && current->ec == Ec::current);
 
+    if (EXPECT_FALSE (xcpu_park))
+        park();
+
     current->ec->activate();
 }
 
+/*
+ * Return the xCPU clone that just finished to the pool of its PD. Called
+ * once its last slice has been charged and another SC has been selected,
+ * so no other CPU can reuse it before this CPU has switched away.
+ */
+void Sc::park()
+{
+    Sc *sc = xcpu_park;
+    xcpu_park = nullptr;
+
+    uint64 t = sc->time;
+    sc->time = 0;
+
+    if (sc->ec->pd->xcpu_give (sc)) {
+        Atomic::add (cross_time[sc->cpu], t);
+        return;
+    }
+
+    sc->time = t;
+
+    Rcu::call (sc->ec);
+    Rcu::call (sc);
+}
+
+/*
+ * Budget consumed in the current period of a reservation, or since the last
+ * refill of the quantum otherwise.
+ */
+uint64 Sc::consumed() const
+{
+    uint64 t = rdtsc();
+
+    if (period && t - period_start >= period)
+        return 0;
+
+    uint64 c = budget - left;
+
+    if (remote_current (cpu) == this && t > tsc)
+        c += t - tsc;
+
+    return c < budget ? c : budget;
+}
+
 void Sc::remote_enqueue(bool inc_ref)
 {
+    if (EXPECT_FALSE (Sc_trace::enabled()))
+        wake = rdtsc();
+
     if (Cpu::id == cpu)
         ready_enqueue (rdtsc(), inc_ref);
 
@@ -171,38 +316,77 @@ void Sc::remote_enqueue(bool inc_ref)
 
         Sc::Rq *r = remote (cpu);
 
-        Lock_guard <Spinlock> guard (r->lock);
+        Sc *q;
+
+        for (;; Counter::rrq_retry++) {
+            prev = nullptr;
+            next = q = ACCESS_ONCE (r->queue);
+
+            if (Atomic::cmp_swap (r->queue, q, this))
+                break;
+        }
 
-        if (r->queue) {
-            next = r->queue;
-            prev = r->queue->prev;
-            next->prev = prev->next = this;
-        } else {
-            r->queue = prev = next = this;
+        /* only the transition from empty to non-empty needs an IPI */
+        if (q)
+            Counter::rrq_coalesced++;
+        else if (ACCESS_ONCE (r->mwait))
+            Counter::rrq_mwait++;
+        else {
+            Sc_trace::event (Sc_trace::WAKEUP_IPI, slot, cpu, rdtsc());
             Lapic::send_ipi (cpu, VEC_IPI_RRQ);
         }
     }
 }
 
+/*
+ * Detach the remote run queue of this CPU in wakeup order.
+ */
+Sc *Sc::rrq_take()
+{
+    Sc *fifo = nullptr;
+
+    /* producers push in LIFO order - reverse to preserve wakeup order */
+    for (Sc *ptr = Atomic::exchange (rq.queue, static_cast<Sc *>(nullptr)); ptr; ) {
+        Sc *sc = ptr;
+        ptr = ptr->next;
+        sc->next = fifo;
+        fifo = sc;
+    }
+
+    return fifo;
+}
+
 void Sc::rrq_handler()
 {
     uint64 t = rdtsc();
 
-    Lock_guard <Spinlock> guard (rq.lock);
+    Sc *fifo = rrq_take();
 
-    for (Sc *ptr = rq.queue; ptr; ) {
+    while (fifo) {
+        Sc *sc = fifo;
+        fifo = fifo->next;
+        sc->next = nullptr;
+        sc->ready_enqueue (t, false);
+    }
+}
 
-        ptr->next->prev = ptr->prev;
-        ptr->prev->next = ptr->next;
+/*
+ * Idle until an interrupt arrives or a remote CPU enqueues an SC. The
+ * exchanges order the mwait flag against the queue check on both sides.
+ */
+void Sc::mwait (unsigned hint)
+{
+    Atomic::exchange (rq.mwait, 1UL);
 
-        Sc *sc = ptr;
+    asm volatile ("monitor" : : "a" (&rq.queue), "c" (0), "d" (0));
 
-        ptr = ptr->next == ptr ? nullptr : ptr->next;
+    if (!rq_pending())
+        asm volatile ("sti; mwait; cli" : : "a" (hint), "c" (0) : "memory");
 
-        sc->ready_enqueue (t, false);
-    }
+    Atomic::exchange (rq.mwait, 0UL);
 
-    rq.queue = nullptr;
+    if (rq_pending())
+        rrq_handler();
 }
 
 void Sc::rke_handler()
@@ -212,6 +396,92 @@ void Sc::rke_handler()
 
     if (Pd::current->Space_mem::htlb.chk (Cpu::id))
         Cpu::hazard |= HZD_SCHED;
+
+    if (EXPECT_FALSE (ACCESS_ONCE (steal_req[Cpu::id])))
+        give();
+}
+
+/*
+ * A ready SC may move to another CPU only if its EC holds no state that is
+ * bound to this CPU: no helping/IPC relation, no armed timeout, no FPU
+ * state in registers, and the PD already has page tables for the target.
+ */
+bool Sc::stealable (unsigned to) const
+{
+    Ec *e = ec;
+
+    return migratable && !disable && e->glb && !e->vcpu() && !e->blocked() &&
+           !e->partner && !e->rcap && !e->xcpu_sm && !e->timeout.active() &&
+           e != Ec::current && e != Ec::fpowner && e->pd->cpus.chk (to);
+}
+
+/*
+ * Hand the highest-priority stealable SC of this CPU to an idle CPU.
+ */
+void Sc::give()
+{
+    unsigned to = Atomic::exchange (steal_req[Cpu::id], 0U);
+
+    if (!to-- || !Hip::cpu_online (to))
+        return;
+
+    for (unsigned p = prio_top(); p; p--) {
+
+        Sc *sc = list[p];
+
+        if (!sc)
+            continue;
+
+        do {
+            if (sc->stealable (to)) {
+
+                trace (TRACE_SCHEDULE, "STEAL:%p PRIO:%#x CPU:%u->%u", sc, p, Cpu::id, to);
+
+                sc->ready_dequeue (rdtsc());
+
+                sc->cpu = to;
+                sc->ec->cpu = static_cast<uint16>(to);
+
+                sc->remote_enqueue (false);
+
+                Counter::steal++;
+                return;
+            }
+        } while ((sc = sc->next) != list[p]);
+    }
+
+    steal_fail[Cpu::id] = rdtsc();
+}
+
+/*
+ * Called by an idle CPU: ask the nearest CPU (same core, same package,
+ * any package) with the most ready migratable SCs to give one away.
+ */
+void Sc::steal()
+{
+    unsigned victim = ~0U, dist = ~0U, load = 0;
+
+    uint64 const t = rdtsc(), backoff = Lapic::freq_tsc / 1000 * steal_backoff_us;
+
+    for (unsigned c = 0; c < NUM_CPU; c++) {
+
+        unsigned l = ACCESS_ONCE (ready_mig[c]);
+
+        if (!l || c == Cpu::id || !Hip::cpu_online (c) || t - ACCESS_ONCE (steal_fail[c]) < backoff)
+            continue;
+
+        unsigned d = Cpu::package[c] != Cpu::package[Cpu::id] ? 2 :
+                     Cpu::core[c]    != Cpu::core[Cpu::id]    ? 1 : 0;
+
+        if (d < dist || (d == dist && l > load)) {
+            victim = c;
+            dist   = d;
+            load   = l;
+        }
+    }
+
+    if (victim != ~0U && Atomic::cmp_swap (steal_req[victim], 0U, Cpu::id + 1))
+        Lapic::send_ipi (victim, VEC_IPI_RKE);
 }
 
 void Sc::operator delete (void *ptr)
@@ -0,0 +1,126 @@
+/*
+ * Scheduler Event Trace
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "bits.hpp"
+#include "buddy.hpp"
+#include "cmdline.hpp"
+#include "lock_guard.hpp"
+#include "pd.hpp"
+#include "sc_trace.hpp"
+#include "stdio.hpp"
+
+Sc_trace::Header *  Sc_trace::header;
+mword               Sc_trace::size;
+Spinlock            Sc_trace::lock;
+
+void Sc_trace::init()
+{
+    if (!Cmdline::sctrace)
+        return;
+
+    mword const pages = 1 + hist_pages + Cpu::online * ring_pages;
+    unsigned short const ord = static_cast<unsigned short>(bit_scan_reverse (pages - 1) + 1);
+
+    Header *h = static_cast<Header *>(Buddy::allocator.alloc (ord, Pd::kern.quota, Buddy::FILL_0));
+    if (!h) {
+        trace (TRACE_ERROR, "SCTRACE: no memory for %lu pages", pages);
+        return;
+    }
+
+    h->cpus        = Cpu::online;
+    h->ring_events = ring_events;
+    h->hist_slots  = hist_slots;
+
+    size = pages * PAGE_SIZE;
+
+    mword const p = Buddy::ptr_to_phys (h);
+
+    Pd::kern.Space_mem::insert_root (Pd::kern.quota, Pd::kern.mdb_cache, p, p + size, 1);
+
+    trace (0, "SCTRACE: %#lx-%#lx", p, p + size);
+
+    barrier();
+
+    header = h;
+}
+
+mword Sc_trace::phys()
+{
+    return header ? Buddy::ptr_to_phys (header) : 0;
+}
+
+unsigned Sc_trace::alloc (mword sel, unsigned cpu, unsigned prio)
+{
+    if (EXPECT_TRUE (!header))
+        return ~0U;
+
+    Lock_guard <Spinlock> guard (lock);
+
+    for (unsigned i = 0; i < hist_slots; i++) {
+
+        Hist &h = hist()[i];
+
+        if (h.sel)
+            continue;
+
+        h.count = 0;
+        h.max   = h.sum = 0;
+
+        for (unsigned b = 0; b < sizeof (h.bucket) / sizeof (*h.bucket); b++)
+            h.bucket[b] = 0;
+
+        h.cpu  = static_cast<uint16>(cpu);
+        h.prio = static_cast<uint16>(prio);
+
+        barrier();
+
+        h.sel = sel + 1;
+
+        return i;
+    }
+
+    return ~0U;
+}
+
+void Sc_trace::free (unsigned slot)
+{
+    if (slot >= hist_slots)
+        return;
+
+    Lock_guard <Spinlock> guard (lock);
+
+    hist()[slot].sel = 0;
+}
+
+void Sc_trace::latency (unsigned slot, uint64 lat)
+{
+    if (slot >= hist_slots)
+        return;
+
+    Hist &h = hist()[slot];
+
+    mword const l = lat > ~0UL ? ~0UL : static_cast<mword>(lat);
+    long const  b = bit_scan_reverse (l | 1) - 8;
+
+    unsigned const nb = sizeof (h.bucket) / sizeof (*h.bucket);
+
+    h.bucket[b < 0 ? 0 : min (static_cast<unsigned>(b), nb - 1)]++;
+    h.cpu = static_cast<uint16>(Cpu::id);
+    h.count++;
+    h.sum += lat;
+
+    if (lat > h.max)
+        h.max = lat;
+}
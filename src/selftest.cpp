@@ -0,0 +1,729 @@
+/*
+ * Boot-Time Self Tests
+ *
+ * This file is part of the NOVA microhypervisor.
+ *
+ * NOVA is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NOVA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License version 2 for more details.
+ */
+
+#include "atomic.hpp"
+#include "buddy.hpp"
+#include "console.hpp"
+#include "cpu.hpp"
+#include "ec.hpp"
+#include "hip.hpp"
+#include "lapic.hpp"
+#include "pd.hpp"
+#include "selftest.hpp"
+#include "sm.hpp"
+#include "stdio.hpp"
+#include "timeout.hpp"
+#include "x86.hpp"
+
+mword Selftest::arrived;
+mword Selftest::generation;
+
+Slab_cache Selftest::cache (sizeof (mword) * 8, 8);
+
+/*
+ * Wait until all online CPUs have arrived. The last one starts the next
+ * generation, which releases the others.
+ */
+void Selftest::rendezvous()
+{
+    mword g = ACCESS_ONCE (generation);
+
+    if (Atomic::add (arrived, 1UL) == Cpu::online) {
+        arrived = 0;
+        Atomic::add (generation, 1UL);
+        return;
+    }
+
+    while (ACCESS_ONCE (generation) == g)
+        pause();
+}
+
+uint64 Selftest::deadline()
+{
+    return rdtsc() + static_cast<uint64>(Lapic::freq_tsc) * 1000;
+}
+
+bool Selftest::expired (uint64 d)
+{
+    pause();
+
+    return rdtsc() > d;
+}
+
+void Selftest::check (bool ok, char const *what)
+{
+    if (EXPECT_FALSE (!ok))
+        Console::panic ("SELFTEST: %s failed on CPU %u", what, Cpu::id);
+}
+
+/*
+ * The n-th online CPU, or ~0U if there are fewer than n + 1.
+ */
+unsigned Selftest::nth_cpu (unsigned n)
+{
+    for (unsigned c = 0; c < NUM_CPU; c++)
+        if (Hip::cpu_online (c) && !n--)
+            return c;
+
+    return ~0U;
+}
+
+/*
+ * Position of this CPU among the online CPUs.
+ */
+unsigned Selftest::rank()
+{
+    unsigned n = 0;
+
+    for (unsigned c = 0; c < Cpu::id; c++)
+        if (Hip::cpu_online (c))
+            n++;
+
+    return n;
+}
+
+unsigned Selftest::random (unsigned &seed)
+{
+    return (seed = seed * 1103515245 + 12345) >> 16;
+}
+
+/*
+ * Scratch page for test state that does not fit into a kernel stack frame.
+ */
+void *Selftest::page()
+{
+    return Buddy::allocator.alloc (0, Pd::kern.quota, Buddy::FILL_0);
+}
+
+void Selftest::free (void *p)
+{
+    Buddy::allocator.free (reinterpret_cast<mword>(p), Pd::kern.quota);
+}
+
+/*
+ * All CPUs allocate and free order-0 pages at once, more than their page
+ * caches hold, and free half of them into the cache of their neighbour.
+ * Zeroing runs in between, and the BSP keeps reclaiming the caches of all
+ * CPUs concurrently. FILL_0 pages must be zero, tags must survive until
+ * the free, and the quota must end up where it started.
+ */
+void Selftest::pages()
+{
+    static unsigned const count = 40, rounds = 200, last = PAGE_SIZE / sizeof (mword) - 1;
+    static mword *box[NUM_CPU][count];
+    static mword base;
+
+    unsigned const next = nth_cpu ((rank() + 1) % Cpu::online);
+    unsigned seed = Cpu::id + 1;
+
+    mword **page = box[Cpu::id];
+
+    auto tag = [] (mword *p, unsigned cpu, mword r) {
+        return reinterpret_cast<mword>(p) ^ r << 16 ^ cpu;
+    };
+
+    auto verify = [&] (mword *p, unsigned cpu, mword r) {
+        check (p[0] == tag (p, cpu, r) && p[last] == tag (p, cpu, r), "page ownership");
+        Buddy::allocator.free (reinterpret_cast<mword>(p), Pd::kern.quota);
+        if (Cpu::bsp)
+            Buddy::pcp_reclaim();
+    };
+
+    rendezvous();
+
+    if (Cpu::bsp)
+        base = Pd::kern.quota.usage();
+
+    rendezvous();
+
+    for (mword r = 0; r < rounds; r++) {
+
+        for (unsigned i = 0; i < count; i++) {
+
+            bool const zero = random (seed) % 2;
+
+            mword *p = page[i] = static_cast<mword *>(Buddy::allocator.alloc (0, Pd::kern.quota, zero ? Buddy::FILL_0 : Buddy::NOFILL));
+
+            for (unsigned j = 0; zero && j <= last; j++)
+                check (!p[j], "page zero fill");
+
+            p[0] = p[last] = tag (p, Cpu::id, r);
+
+            if (!(i % 8))
+                Buddy::prezero();
+        }
+
+        rendezvous();
+
+        for (unsigned i = 0; i < count; i += 2) {
+            verify (page[i], Cpu::id, r);
+            verify (box[next][i + 1], next, r);
+        }
+
+        rendezvous();
+    }
+
+    Buddy::Pcp const &p = Buddy::pcp[Cpu::id];
+
+    check (p.count <= Buddy::pcp_max && p.zeroed <= Buddy::pcp_zero, "page cache bounds");
+
+    rendezvous();
+
+    if (Cpu::bsp)
+        check (Pd::kern.quota.usage() == base, "page quota returned");
+}
+
+/*
+ * Ready SCs at random priorities are enqueued and dequeued in random order
+ * on every CPU, and after each step the two-level bitmap must yield the
+ * same top priority as a plain count per priority.
+ */
+void Selftest::prio()
+{
+    static unsigned const count = 64;
+
+    struct Scratch
+    {
+        Sc *        sc[count];
+        unsigned    ready[Sc::priorities];
+    } *s = static_cast<Scratch *>(page());
+
+    static_assert (sizeof (Scratch) <= PAGE_SIZE, "Scratch too large");
+
+    Ec *ec = new (Pd::kern) Ec (&Pd::kern, Ec::idle, Cpu::id);
+
+    unsigned const base = Sc::prio_top();
+    unsigned seed = Cpu::id + 1, n = 0;
+
+    auto top = [&] {
+        for (unsigned p = Sc::priorities; --p > base; )
+            if (s->ready[p])
+                return p;
+        return base;
+    };
+
+    for (; n < count; n++) {
+
+        unsigned p = 1 + random (seed) % (Sc::priorities - 1);
+
+        s->sc[n] = new (Pd::kern) Sc (&Pd::kern, 0, ec, Cpu::id, p, Sc::default_quantum);
+        s->sc[n]->ready_enqueue (rdtsc(), false);
+        s->ready[p]++;
+
+        check (Sc::prio_top() == top(), "priority bitmap enqueue");
+    }
+
+    while (n) {
+
+        unsigned i = random (seed) % n;
+        Sc *sc = s->sc[i];
+
+        s->sc[i] = s->sc[--n];
+
+        sc->ready_dequeue (rdtsc());
+        s->ready[sc->prio]--;
+
+        check (Sc::prio_top() == top(), "priority bitmap dequeue");
+
+        delete sc;
+    }
+
+    Ec::destroy (ec, Pd::kern);
+
+    free (s);
+}
+
+/*
+ * All other CPUs push SCs onto the remote run queue of one consumer, which
+ * detaches it concurrently. Every SC must arrive exactly once per round,
+ * and the SCs of each producer in the order they were pushed. The selector
+ * of a test SC encodes its producer and sequence number.
+ */
+void Selftest::rrq()
+{
+    static unsigned const per = 8, rounds = 2000;
+    static mword ack;
+
+    unsigned const consumer = nth_cpu (0);
+
+    if (nth_cpu (1) == ~0U)
+        return;
+
+    Ec *ec = new (Pd::kern) Ec (&Pd::kern, Ec::idle, consumer);
+    Sc **sc = static_cast<Sc **>(page());
+    unsigned *seq = reinterpret_cast<unsigned *>(sc + per);
+
+    if (Cpu::id == consumer)
+        ack = 0;
+    else
+        for (unsigned i = 0; i < per; i++)
+            sc[i] = new (Pd::kern) Sc (&Pd::kern, rank() * per + i, ec, consumer, Sc::default_prio, Sc::default_quantum);
+
+    rendezvous();
+
+    for (mword r = 1; r <= rounds; r++) {
+
+        if (Cpu::id != consumer) {
+
+            for (unsigned i = 0; i < per; i++)
+                sc[i]->remote_enqueue (false);
+
+            for (uint64 d = deadline(); ACCESS_ONCE (ack) != r; )
+                check (!expired (d), "remote run queue round acknowledged");
+
+            continue;
+        }
+
+        for (unsigned c = 0; c < NUM_CPU; c++)
+            seq[c] = 0;
+
+        uint64 const d = deadline();
+
+        for (unsigned n = per * (Cpu::online - 1); n; ) {
+
+            Sc *fifo = Sc::rrq_take();
+
+            if (!fifo) {
+                check (!expired (d), "remote run queue delivery");
+                continue;
+            }
+
+            for (; fifo; n--) {
+                Sc *s = fifo;
+                fifo = fifo->next;
+                s->next = nullptr;
+
+                check (n && s->cpu == consumer, "remote run queue duplicate");
+                check (seq[s->node_base / per]++ == s->node_base % per, "remote run queue order");
+            }
+        }
+
+        ACCESS_ONCE (ack) = r;
+    }
+
+    rendezvous();
+
+    if (Cpu::id != consumer)
+        for (unsigned i = 0; i < per; i++)
+            delete sc[i];
+
+    Ec::destroy (ec, Pd::kern);
+
+    free (sc);
+}
+
+/*
+ * All other CPUs keep stealing from one victim with a set of ready
+ * migratable SCs, until it has given all of them away. Every SC must
+ * arrive at exactly one thief, retargeted to that CPU. Pd::kern has no
+ * per-CPU page tables, so the thieves mark themselves in its CPU set for
+ * the duration of the test.
+ */
+void Selftest::steal()
+{
+    static unsigned const count = 64;
+    static mword done;
+
+    static struct Scratch
+    {
+        Sc *        sc[count];
+        mword       got[count];
+    } *s;
+
+    static_assert (sizeof (Scratch) <= PAGE_SIZE, "Scratch too large");
+
+    unsigned const victim = nth_cpu (0);
+
+    if (nth_cpu (1) == ~0U)
+        return;
+
+    unsigned const base = Sc::ready_mig[victim];
+    bool const mark = Cpu::id != victim && Pd::kern.cpus.set (Cpu::id);
+
+    if (Cpu::id == victim) {
+
+        s = static_cast<Scratch *>(page());
+        done = 0;
+
+        for (unsigned i = 0; i < count; i++) {
+            Ec *ec = new (Pd::kern) Ec (&Pd::kern, Ec::idle, victim);
+            s->sc[i] = new (Pd::kern) Sc (&Pd::kern, i, ec, victim, 1 + i % 8, Sc::default_quantum, true);
+            s->sc[i]->ready_enqueue (rdtsc(), false);
+        }
+    }
+
+    rendezvous();
+
+    if (Cpu::id == victim) {
+
+        for (uint64 d = deadline(); ACCESS_ONCE (Sc::ready_mig[victim]) != base; ) {
+
+            if (ACCESS_ONCE (Sc::steal_req[victim])) {
+                Sc::give();
+                d = deadline();
+            }
+
+            check (!expired (d), "work stealing progress");
+        }
+
+        ACCESS_ONCE (done) = 1;
+
+    } else
+
+        for (bool last = false; !last; ) {
+
+            last = ACCESS_ONCE (done);
+
+            Sc::steal();
+
+            for (Sc *fifo = Sc::rrq_take(); fifo; ) {
+                Sc *sc = fifo;
+                fifo = fifo->next;
+                sc->next = nullptr;
+
+                check (sc->cpu == Cpu::id && sc->ec->cpu == Cpu::id, "work stealing target");
+
+                Atomic::add (s->got[sc->node_base], 1UL);
+            }
+
+            pause();
+        }
+
+    rendezvous();
+
+    if (mark)
+        Pd::kern.cpus.clr (Cpu::id);
+
+    if (Cpu::id == victim) {
+
+        Sc::steal_req[victim] = 0;
+
+        for (unsigned i = 0; i < count; i++) {
+
+            check (s->got[i] == 1, "work stealing delivery");
+
+            Ec *ec = s->sc[i]->ec;
+            delete s->sc[i];
+            Ec::destroy (ec, Pd::kern);
+        }
+
+        free (s);
+    }
+}
+
+/*
+ * All CPUs allocate from one slab cache at once, beyond what their magazines
+ * hold, and tag every word of each element. After a rendezvous, each CPU
+ * frees half of its own elements and half of those of its neighbour, so
+ * elements cross between magazines. An element handed out twice shows up
+ * as a clobbered tag. Finally the cache must return all of its memory.
+ */
+void Selftest::slab()
+{
+    static unsigned const count = 48, rounds = 500;
+    static void **box[NUM_CPU];
+    static mword base;
+
+    unsigned const next = nth_cpu ((rank() + 1) % Cpu::online);
+
+    void **obj = box[Cpu::id] = static_cast<void **>(page());
+
+    static_assert (sizeof (*obj) * count <= PAGE_SIZE, "Box too large");
+
+    auto tag = [] (void *p, unsigned cpu, mword r) {
+        return reinterpret_cast<mword>(p) ^ r << 16 ^ cpu;
+    };
+
+    auto verify = [&] (void *p, unsigned cpu, mword r) {
+        mword *w = static_cast<mword *>(p);
+        for (unsigned i = 0; i < cache.size / sizeof (mword); i++)
+            check (w[i] == tag (p, cpu, r), "slab element ownership");
+        cache.free (p, Pd::kern.quota);
+    };
+
+    rendezvous();
+
+    if (Cpu::bsp)
+        base = Pd::kern.quota.usage();
+
+    rendezvous();
+
+    for (mword r = 0; r < rounds; r++) {
+
+        for (unsigned i = 0; i < count; i++) {
+
+            mword *w = static_cast<mword *>(obj[i] = cache.alloc (Pd::kern.quota));
+
+            check (w, "slab allocation");
+
+            for (unsigned j = 0; j < cache.size / sizeof (mword); j++)
+                w[j] = tag (w, Cpu::id, r);
+        }
+
+        rendezvous();
+
+        for (unsigned i = 0; i < count; i += 2) {
+            verify (obj[i], Cpu::id, r);
+            verify (box[next][i + 1], next, r);
+        }
+
+        rendezvous();
+    }
+
+    if (Cpu::bsp) {
+        cache.free (Pd::kern.quota);
+        check (Pd::kern.quota.usage() == base, "slab memory returned");
+    }
+
+    rendezvous();
+
+    free (obj);
+}
+
+/*
+ * Random enqueue and dequeue of timeouts on the pairing heap of every CPU,
+ * checked against a linear scan for the earliest one. The heap must then
+ * drain in time order, and Timeout::check must trigger exactly the expired
+ * timeouts, earliest first. The timeouts already queued on the CPU are set
+ * aside for the duration of the test.
+ */
+void Selftest::timeout()
+{
+    static unsigned const count = 64, rounds = 20000;
+
+    class Probe : public Timeout
+    {
+        private:
+            void trigger() { fired = ++*clock; }
+
+            Probe (Probe const &);
+            Probe &operator = (Probe const &);
+
+        public:
+            uint64 *clock;
+            uint64  fired { 0 };
+
+            ALWAYS_INLINE
+            inline explicit Probe (uint64 *c) : clock (c) {}
+
+            ALWAYS_INLINE
+            inline uint64 when() const { return time; }
+
+            ALWAYS_INLINE
+            static inline void *operator new (size_t, void *p) { return p; }
+    } *p = static_cast<Probe *>(page());
+
+    static_assert (sizeof (Probe) * count <= PAGE_SIZE, "Probe too large");
+
+    Timeout *saved = Timeout::list;
+    Timeout::list = nullptr;
+
+    uint64 clock = 0, future = Lapic::time() + static_cast<uint64>(Lapic::freq_tsc) * 1000 * 3600;
+    unsigned seed = Cpu::id + 1;
+
+    for (unsigned i = 0; i < count; i++)
+        new (p + i) Probe (&clock);
+
+    auto earliest = [&] {
+        uint64 e = ~0ULL;
+        for (unsigned i = 0; i < count; i++)
+            if (p[i].active() && p[i].when() < e)
+                e = p[i].when();
+        return e;
+    };
+
+    for (unsigned r = 0; r < rounds; r++) {
+
+        Probe &t = p[random (seed) % count];
+
+        if (t.active())
+            t.dequeue();
+        else
+            t.enqueue (future + random (seed) % 1024);
+
+        check (Timeout::earliest() == earliest(), "timeout heap minimum");
+    }
+
+    for (uint64 last = 0; Timeout::list; ) {
+
+        uint64 t = Timeout::list->dequeue();
+
+        check (t >= last && Timeout::earliest() == earliest(), "timeout heap order");
+
+        last = t;
+    }
+
+    // Even probes have expired, the earliest at the highest index
+    for (unsigned i = 0; i < count; i++)
+        p[i].enqueue (i % 2 ? future + i : count - i);
+
+    Timeout::check();
+
+    for (unsigned i = 0; i < count; i++) {
+        check (i % 2 ? !p[i].fired && p[i].active() : p[i].fired == (count - i) / 2 && !p[i].active(), "timeout expiry");
+        p[i].~Probe();
+    }
+
+    check (!Timeout::list, "timeout heap empty");
+
+    Timeout::list = saved;
+    Timeout::sync();
+
+    free (p);
+}
+
+/*
+ * Plain and doorbell semaphores under concurrent up and dn from all CPUs.
+ * Only the non-blocking paths are used: every CPU ups and then takes one
+ * count again, so the plain counter must end at zero, and a doorbell must
+ * never count beyond one. A lost count shows up as a CPU stuck in dn.
+ */
+void Selftest::sm()
+{
+    static Sm *plain, *bell;
+    static unsigned const rounds = 100000;
+
+    if (Cpu::bsp) {
+        plain = new (Pd::kern) Sm (&Pd::kern, 0);
+        bell  = new (Pd::kern) Sm (&Pd::kern, 0, 0, nullptr, 0, true);
+    }
+
+    rendezvous();
+
+    for (unsigned i = 0; i < rounds; i++) {
+
+        plain->up();
+
+        for (uint64 d = deadline(); !plain->dn_fast (false); )
+            check (!expired (d), "SM count lost");
+    }
+
+    rendezvous();
+
+    check (!ACCESS_ONCE (plain->counter), "SM count balance");
+
+    for (unsigned i = 0; i < rounds; i++) {
+
+        bell->up();
+
+        check (ACCESS_ONCE (bell->counter) <= 1, "doorbell saturation");
+
+        if (Cpu::bsp)
+            bell->dn_fast (true);
+    }
+
+    rendezvous();
+
+    check (ACCESS_ONCE (bell->counter) <= 1, "doorbell saturation");
+
+    if (Cpu::bsp) {
+        Sm::destroy (plain, Pd::kern);
+        Sm::destroy (bell,  Pd::kern);
+    }
+}
+
+/*
+ * A producer publishes bursts into a shared ring and rings a doorbell after
+ * every entry, while a consumer races through dn and drains the ring after
+ * each successful one. Once the producer has finished a burst, a doorbell
+ * that can no longer be taken must mean an empty ring, otherwise the
+ * wakeup for the last entries was lost.
+ */
+void Selftest::sm_ring()
+{
+    static Sm *bell;
+    static mword ring[64], head, tail, done, ack;
+    static unsigned const rounds = 20000;
+
+    unsigned const consumer = nth_cpu (0), producer = nth_cpu (1);
+
+    if (producer == ~0U)
+        return;
+
+    if (Cpu::id == consumer) {
+        bell = new (Pd::kern) Sm (&Pd::kern, 0, 0, nullptr, 0, true);
+        head = tail = done = ack = 0;
+    }
+
+    rendezvous();
+
+    if (Cpu::id == producer)
+        for (mword r = 1; r <= rounds; r++) {
+
+            for (unsigned i = 0; i < r % 32 + 1; i++) {
+
+                for (uint64 d = deadline(); head - ACCESS_ONCE (tail) == sizeof (ring) / sizeof (*ring); )
+                    check (!expired (d), "ring drained");
+
+                ACCESS_ONCE (ring[head % (sizeof (ring) / sizeof (*ring))]) = head;
+                ACCESS_ONCE (head) = head + 1;
+
+                bell->up();
+            }
+
+            ACCESS_ONCE (done) = r;
+
+            for (uint64 d = deadline(); ACCESS_ONCE (ack) != r; )
+                check (!expired (d), "ring round acknowledged");
+        }
+
+    if (Cpu::id == consumer)
+        for (mword r = 1; r <= rounds; r++) {
+
+            for (uint64 d = deadline();;) {
+
+                bool const last = ACCESS_ONCE (done) == r;
+
+                if (bell->dn_fast (true)) {
+                    for (; tail != ACCESS_ONCE (head); ACCESS_ONCE (tail) = tail + 1)
+                        check (ACCESS_ONCE (ring[tail % (sizeof (ring) / sizeof (*ring))]) == tail, "ring order");
+                    continue;
+                }
+
+                if (last) {
+                    check (tail == ACCESS_ONCE (head), "doorbell wakeup");
+                    break;
+                }
+
+                check (!expired (d), "doorbell ring progress");
+            }
+
+            ACCESS_ONCE (ack) = r;
+        }
+
+    rendezvous();
+
+    if (Cpu::id == consumer)
+        Sm::destroy (bell, Pd::kern);
+}
+
+void Selftest::run()
+{
+    rendezvous();
+
+    prio();
+    rrq();
+    steal();
+    timeout();
+    slab();
+    pages();
+    sm();
+    sm_ring();
+
+    rendezvous();
+
+    if (Cpu::bsp)
+        trace (0, "SELFTEST: passed on %u CPUs", Cpu::online);
+}
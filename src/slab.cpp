@@ -20,6 +20,8 @@
 
 #include "assert.hpp"
 #include "bits.hpp"
+#include "counter.hpp"
+#include "cpu.hpp"
 #include "lock_guard.hpp"
 #include "slab.hpp"
 #include "stdio.hpp"
@@ -75,8 +77,19 @@ Slab_cache::Slab_cache (unsigned long elem_size, unsigned elem_align)
            elem_align);
 }
 
+Slab_cache::Magazine *Slab_cache::magazine()
+{
+    Magazine *m = ACCESS_ONCE (mag);
+
+    return m && Buddy::cpu_local() && !Cpu::preemption ? m + Cpu::id : nullptr;
+}
+
 void Slab_cache::grow(Quota &quota)
 {
+    // The magazine page is optional, take it only if the slab page fits as well
+    if (head && !mag && !quota.hit_limit (2))
+        mag = static_cast<Magazine *>(Buddy::allocator.alloc (0, quota, Buddy::FILL_0));
+
     Slab *slab = new (quota) Slab (this);
 
     if (head)
@@ -88,11 +101,30 @@ void Slab_cache::grow(Quota &quota)
 
 void *Slab_cache::alloc(Quota &quota)
 {
+    Magazine *m = magazine();
+
+    if (EXPECT_TRUE (m && m->rounds)) {
+        Counter::slab_mag++;
+        return m->round[--m->rounds];
+    }
+
     Lock_guard <Spinlock> guard (lock);
 
     if (EXPECT_FALSE (!curr))
         grow(quota);
 
+    void *ret = get();
+
+    // Refill half of the magazine from slabs that are already there
+    if (m)
+        while (curr && m->rounds < mag_rounds / 2)
+            m->round[m->rounds++] = get();
+
+    return ret;
+}
+
+void *Slab_cache::get()
+{
     assert (!curr->full());
     assert (!curr->next || curr->next->full());
 
@@ -107,8 +139,26 @@ void *Slab_cache::alloc(Quota &quota)
 
 void Slab_cache::free (void *ptr, Quota &quota)
 {
+    Magazine *m = magazine();
+
+    if (EXPECT_TRUE (m && m->rounds < mag_rounds)) {
+        Counter::slab_mag++;
+        m->round[m->rounds++] = ptr;
+        return;
+    }
+
     Lock_guard <Spinlock> guard (lock);
 
+    put (ptr, quota);
+
+    // Return half of the magazine to the slabs
+    if (m)
+        while (m->rounds > mag_rounds / 2)
+            put (m->round[--m->rounds], quota);
+}
+
+void Slab_cache::put (void *ptr, Quota &quota)
+{
     Slab *slab = reinterpret_cast<Slab *>(reinterpret_cast<mword>(ptr) & ~PAGE_MASK);
 
     assert (slab->cache == this);
@@ -175,6 +225,15 @@ void Slab_cache::free (void *ptr, Quota &quota)
 
 void Slab_cache::free (Quota &quota)
 {
+    if (mag) {
+        for (unsigned c = 0; c < NUM_CPU; c++)
+            while (mag[c].rounds)
+                put (mag[c].round[--mag[c].rounds], quota);
+
+        Buddy::allocator.free (reinterpret_cast<mword>(mag), quota);
+        mag = nullptr;
+    }
+
     while (head) {
         assert (!head->full());
         assert (head->cache == this);
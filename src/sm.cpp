@@ -21,7 +21,7 @@
 #include "sm.hpp"
 #include "stdio.hpp"
 
-Sm::Sm (Pd *own, mword sel, mword cnt, Sm * s, mword v) : Kobject (SM, static_cast<Space_obj *>(own), sel, 0x3, free), Si (s, v), counter (cnt)
+Sm::Sm (Pd *own, mword sel, mword cnt, Sm * s, mword v, bool d, bool set) : Kobject (SM, static_cast<Space_obj *>(own), sel, 0x3, free), Si (s, v), counter (d || set ? min (cnt, 1UL) : cnt), doorbell (d || set), sigset (set)
 {
-    trace (TRACE_SYSCALL, "SM:%p created (CNT:%lu)", this, cnt);
+    trace (TRACE_SYSCALL, "SM:%p created (CNT:%lu%s)", this, counter, set ? " signal set" : d ? " doorbell" : "");
 }
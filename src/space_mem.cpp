@@ -219,7 +219,7 @@ static void free_mdb(Rcu_elem * e)
     Mdb::destroy (mdb, pd->quota, pd->mdb_cache);
 }
 
-bool Space_mem::insert_utcb (Quota &quota, Slab_cache &cache, mword b, mword phys)
+bool Space_mem::insert_utcb (Quota &quota, Slab_cache &cache, mword b, mword phys, unsigned o)
 {
     if (!phys)
        return true;
@@ -227,7 +227,7 @@ bool Space_mem::insert_utcb (Quota &quota, Slab_cache &cache, mword b, mword phy
     if (!b)
         return true;
 
-    Mdb *mdb = new (quota, cache) Mdb (this, free_mdb, phys, b >> PAGE_BITS, 0, 0x3);
+    Mdb *mdb = new (quota, cache) Mdb (this, free_mdb, phys, b >> PAGE_BITS, o, 0x3);
 
     if (tree_insert (mdb))
         return true;
@@ -43,6 +43,9 @@ void Ec::sys_finish()
 
     current->regs.set_status (S);
 
+    if (EXPECT_FALSE (current->batch))
+        batch_done();
+
     if (current->xcpu_sm)
         xcpu_return();
 
@@ -55,11 +58,27 @@ void Ec::sys_finish()
 void Ec::activate()
 {
     Ec *ec = this;
+    Sc *sc = Sc::current;
+
+    Sc::ctr_link = 0;
+
+    /* resume the walk at the cached end unless a reply shortened the chain */
+    if (sc->chain_ec == this && sc->chain_cpu == Cpu::id && sc->chain_gen == Sc::chain_reply[Cpu::id]) {
+        ec = sc->chain_end;
+        Sc::ctr_link = sc->chain_len;
+        Counter::help_saved += sc->chain_len;
+    }
 
     // XXX: Make the loop preemptible
-    for (Sc::ctr_link = 0; ec->partner; ec = ec->partner)
+    for (; ec->partner; ec = ec->partner)
         Sc::ctr_link++;
 
+    sc->chain_ec  = this;
+    sc->chain_end = ec;
+    sc->chain_len = Sc::ctr_link;
+    sc->chain_cpu = Cpu::id;
+    sc->chain_gen = Sc::chain_reply[Cpu::id];
+
     if (EXPECT_FALSE (ec->blocked()))
         ec->block_sc();
 
@@ -80,9 +99,9 @@ void Ec::delegate()
     dst->pd->xfer_items (src->pd,
                          user ? dst->utcb->xlt : Crd (0),
                          user ? dst->utcb->del : Crd (Crd::MEM, (dst->cont == ret_user_iret ? dst->regs.cr2 : dst->regs.nst_fault) >> PAGE_BITS),
-                         src->utcb->xfer(),
-                         user ? dst->utcb->xfer() : nullptr,
-                         src->utcb->ti());
+                         src->utcb->xfer (src->utcb_order),
+                         user ? dst->utcb->xfer (dst->utcb_order) : nullptr,
+                         src->utcb->ti (user ? src->xfer_order (dst) : src->utcb_order));
 
     if (Cpu::hazard & HZD_OOM) {
         if (dst->pd->quota.hit_limit())
@@ -123,6 +142,13 @@ void Ec::send_msg()
     die ("IPC Timeout");
 }
 
+/*
+ * There is deliberately no separate IPC fast path. The portal lookup is a
+ * single load from the capability window, and the quota and helping checks
+ * are a few compares. The remaining cost is the switch in make_current, so
+ * a fast path would have to duplicate the partner, FPU and hazard handling
+ * of the generic path.
+ */
 void Ec::sys_call()
 {
     Sys_call *s = static_cast<Sys_call *>(current->sys_regs());
@@ -192,7 +218,7 @@ void Ec::recv_user()
 {
     Ec *ec = current->rcap;
 
-    ec->utcb->save (current->utcb);
+    ec->utcb->save (current->utcb, ec->xfer_order (current));
 
     if (EXPECT_FALSE (ec->utcb->tcnt()))
         delegate<true>();
@@ -264,6 +290,9 @@ bool Ec::migrate(Capability &cap_e, Ec *ec_r, Sys_ec_ctrl const &r)
     if ((pt->ec->cpu != r.cpu()) || (sc->ec != ec_m))
         return false;
 
+    if (sc->util && !Sc::edf_admit (r.cpu(), sc->util))
+        return false;
+
     Ec *new_ec = new (*ec_m->pd) Ec (Pd::current, ec_m->pd, ec_m->cont, r.cpu(), ec_m, pt);
     Sc *new_sc = new (*new_ec->pd) Sc (Pd::current, new_ec, *sc);
 
@@ -343,7 +372,7 @@ void Ec::sys_reply()
         assert (current->cont != ret_xcpu_reply);
 
         if (EXPECT_TRUE ((ec->cont == ret_user_sysexit) || ec->cont == xcpu_return))
-            src->save (ec->utcb);
+            src->save (ec->utcb, current->xfer_order (ec));
         else if (ec->cont == ret_user_iret)
             fpu = src->save_exc (&ec->regs);
         else if (ec->cont == ret_user_vmresume)
@@ -364,7 +393,7 @@ void Ec::check(mword r, bool call)
     if (Pd::current->quota.hit_limit(r)) {
         trace(TRACE_OOM, "%s:%u - not enough resources %lu/%lu (%lu)", __func__, __LINE__, Pd::current->quota.usage(), Pd::current->quota.limit(), r);
 
-        if (Ec::current->pt_oom && call)
+        if (Ec::current->pt_oom && call && !Ec::current->batch)
             Ec::current->oom_call_cpu (Ec::current->pt_oom, Ec::current->pt_oom->id, C, C);
 
         sys_finish<Sys_regs::QUO_OOM>();
@@ -451,12 +480,17 @@ void Ec::sys_create_ec()
     }
     Pd *pd = static_cast<Pd *>(cap_pd.obj());
 
-    if (pd->quota.hit_limit(7)) {
+    if (EXPECT_FALSE (r->utcb_order() > (r->utcb() ? Utcb::order_max : 0))) {
+        trace (TRACE_ERROR, "%s: Invalid UTCB order (%u)", __func__, r->utcb_order());
+        sys_finish<Sys_regs::BAD_PAR>();
+    }
+
+    if (pd->quota.hit_limit(6 + (1UL << r->utcb_order()))) {
         trace(TRACE_OOM, "%s:%u - not enough resources %lu/%lu", __func__, __LINE__, pd->quota.usage(), pd->quota.limit());
         sys_finish<Sys_regs::QUO_OOM>();
     }
 
-    if (EXPECT_FALSE (r->utcb() >= USER_ADDR || r->utcb() & PAGE_MASK || !pd->insert_utcb (pd->quota, pd->mdb_cache, r->utcb()))) {
+    if (EXPECT_FALSE (r->utcb() >= USER_ADDR || r->utcb() & ((PAGE_SIZE << r->utcb_order()) - 1) || !pd->insert_utcb (pd->quota, pd->mdb_cache, r->utcb()))) {
         trace (TRACE_ERROR, "%s: Invalid UTCB address (%#lx)", __func__, r->utcb());
         sys_finish<Sys_regs::BAD_PAR>();
     }
@@ -464,7 +498,7 @@ void Ec::sys_create_ec()
     Capability cap_pt = Space_obj::lookup (r->sel() + 1);
     Pt *pt = cap_pt.obj()->type() == Kobject::PT ? static_cast<Pt *>(cap_pt.obj()) : nullptr;
 
-    Ec *ec = new (*pd) Ec (Pd::current, r->sel(), pd, r->flags() & 1 ? static_cast<void (*)()>(send_msg<ret_user_iret>) : nullptr, r->cpu(), r->evt(), r->utcb(), r->esp(), pt);
+    Ec *ec = new (*pd) Ec (Pd::current, r->sel(), pd, r->flags() & 1 ? static_cast<void (*)()>(send_msg<ret_user_iret>) : nullptr, r->cpu(), r->evt(), r->utcb(), r->esp(), pt, r->utcb_order());
 
     if (!Space_obj::insert_root (pd->quota, ec)) {
         trace (TRACE_ERROR, "%s: Non-NULL CAP (%#lx)", __func__, r->sel());
@@ -512,7 +546,30 @@ void Ec::sys_create_sc()
         sys_finish<Sys_regs::BAD_PAR>();
     }
 
-    Sc *sc = new (*ec->pd) Sc (Pd::current, r->sel(), ec, ec->cpu, r->qpd().prio(), r->qpd().quantum());
+    if (EXPECT_FALSE (r->period() && r->period() < r->qpd().quantum())) {
+        trace (TRACE_ERROR, "%s: Invalid period (%u)", __func__, r->period());
+        sys_finish<Sys_regs::BAD_PAR>();
+    }
+
+    if (EXPECT_FALSE (r->edf() ? !Cmdline::edf || !r->period() || r->migratable() : Cmdline::edf && r->qpd().prio() == Sc::edf_prio)) {
+        trace (TRACE_ERROR, "%s: Invalid EDF parameters", __func__);
+        sys_finish<Sys_regs::BAD_PAR>();
+    }
+
+    if (EXPECT_FALSE (!ec->bind_sc (r->migratable()))) {
+        trace (TRACE_ERROR, "%s: Cannot bind %s SC", __func__, r->migratable() ? "migratable" : "fixed");
+        sys_finish<Sys_regs::BAD_CAP>();
+    }
+
+    if (EXPECT_FALSE (r->edf() && !Sc::edf_admit (ec->cpu, Sc::edf_share (r->qpd().quantum(), r->period())))) {
+        trace (TRACE_ERROR, "%s: EDF admission failed", __func__);
+        ec->unbind_sc (r->migratable());
+        sys_finish<Sys_regs::BAD_PAR>();
+    }
+
+    Sc *sc = new (*ec->pd) Sc (Pd::current, r->sel(), ec, ec->cpu, r->edf() ? Sc::edf_prio : r->qpd().prio(), r->qpd().quantum(), r->migratable(), r->period());
+    sc->bound = true;
+
     if (!Space_obj::insert_root (pd->quota, sc)) {
         trace (TRACE_ERROR, "%s: Non-NULL CAP (%#lx)", __func__, r->sel());
         delete sc;
@@ -594,6 +651,11 @@ void Ec::sys_create_sm()
     Sm * sm;
 
     if (r->sm()) {
+        if (EXPECT_FALSE (r->doorbell() || r->sigset())) {
+            trace (TRACE_ERROR, "%s: Doorbell SM cannot be chained", __func__);
+            sys_finish<Sys_regs::BAD_PAR>();
+        }
+
         /* check for valid SM to be chained with */
         Capability cap_si = Space_obj::lookup (r->sm());
         if (EXPECT_FALSE (cap_si.obj()->type() != Kobject::SM)) {
@@ -608,9 +670,14 @@ void Ec::sys_create_sm()
             sys_finish<Sys_regs::BAD_CAP>();
         }
 
+        if (EXPECT_FALSE (!si->chainable (r->cnt()))) {
+            trace (TRACE_ERROR, "%s: SM CAP (%#lx) is doorbell or value %#lx out of range", __func__, r->sm(), r->cnt());
+            sys_finish<Sys_regs::BAD_PAR>();
+        }
+
         sm = new (*Pd::current) Sm (Pd::current, r->sel(), 0, si, r->cnt());
     } else
-        sm = new (*Pd::current) Sm (Pd::current, r->sel(), r->cnt());
+        sm = new (*Pd::current) Sm (Pd::current, r->sel(), r->cnt(), nullptr, 0, r->doorbell(), r->sigset());
 
     if (!Space_obj::insert_root (pd->quota, sm)) {
         trace (TRACE_ERROR, "%s: Non-NULL CAP (%#lx)", __func__, r->sel());
@@ -711,9 +778,9 @@ void Ec::sys_misc()
         pd_dst->xfer_items (pd_snd,
                             Crd (0),
                             s->crd(),
-                            current->utcb->xfer(),
+                            current->utcb->xfer (current->utcb_order),
                             nullptr,
-                            current->utcb->ti());
+                            current->utcb->ti (current->utcb_order));
 
         if (Cpu::hazard & HZD_OOM) {
            Cpu::hazard &= ~HZD_OOM;
@@ -733,6 +800,20 @@ void Ec::sys_misc()
 
         sys_finish<Sys_regs::SUCCESS>();
     }
+    case Sys_misc::SYS_BATCH: {
+        unsigned const n = static_cast<unsigned>(current->utcb->ui (current->utcb_order) / Sys_misc::batch_words);
+
+        trace (TRACE_SYSCALL, "EC:%p SYS_BATCH N:%u", current, n);
+
+        if (EXPECT_FALSE (!n || current->xcpu_sm))
+            sys_finish<Sys_regs::BAD_PAR>();
+
+        current->batch      = n;
+        current->batch_pos  = 0;
+        current->batch_stop = s->batch_stop();
+
+        batch_run();
+    }
     default:
         sys_finish<Sys_regs::BAD_PAR>();
     }
@@ -896,6 +977,13 @@ void Ec::sys_sc_ctrl()
 
     Sc *sc = static_cast<Sc *>(cap.obj());
 
+    if (r->budget()) { /* budget consumed in current period, depletions */
+        uint32 dummy;
+        r->set_time (div64 (sc->consumed() * 1000, Lapic::freq_tsc, &dummy), sc->depleted);
+
+        sys_finish<Sys_regs::SUCCESS>();
+    }
+
     uint64 sc_time = sc->time;
     uint64 ec_time = 0;
 
@@ -1161,8 +1249,7 @@ void Ec::sys_xcpu_call()
 
     current->xcpu_sm = new (*Pd::current) Sm (Pd::current, UNUSED, CNT);
 
-    Ec *xcpu_ec = new (*Pd::current) Ec (Pd::current, Pd::current, Ec::sys_call, ec->cpu, current);
-    Sc *xcpu_sc = new (*xcpu_ec->pd) Sc (Pd::current, xcpu_ec, xcpu_ec->cpu, Sc::current);
+    Sc *xcpu_sc = xcpu_clone (ec->cpu);
 
     current->cont = ret_xcpu_reply;
 
@@ -1209,6 +1296,89 @@ void (*const syscall[])() =
     &Ec::sys_pd_ctrl,
 };
 
+/*
+ * SYS_BATCH executes the system calls encoded in the untyped words of the
+ * UTCB one after another. Each entry gets its registers written back with
+ * the status in ARG_1. Only calls that neither block nor use the UTCB are
+ * accepted. Delegation is left out because all entries would share the
+ * typed items of the one UTCB. A quota shortage fails the entry instead of
+ * invoking the OOM portal, because that IPC would overwrite the remaining
+ * entries. A pending recall or single step ends the batch with COM_ABT
+ * after the current entry.
+ */
+void Ec::batch_run()
+{
+    Sys_regs *r = current->sys_regs();
+    mword const *e = current->utcb->untyped() + current->batch_pos * Sys_misc::batch_words;
+
+    r->ARG_1 = e[0];
+    r->ARG_2 = e[1];
+    r->ARG_3 = e[2];
+    r->ARG_4 = e[3];
+    r->ARG_5 = e[4];
+
+    void (*const s)() = syscall[r->ARG_1 & 0xf];
+
+    bool ok = s == sys_create_pd || s == sys_create_ec || s == sys_create_sc ||
+              s == sys_create_pt || s == sys_create_sm || s == sys_pt_ctrl;
+
+    if (s == sys_misc)
+        ok = r->flags() == Sys_misc::SYS_LOOKUP;
+
+    if (s == sys_sm_ctrl)
+        ok = static_cast<Sys_sm_ctrl *>(r)->op() == 0;
+
+    if (EXPECT_FALSE (!ok)) {
+        trace (TRACE_ERROR, "%s: Call %lu not permitted in batch", __func__, r->ARG_1 & 0xf);
+        sys_finish<Sys_regs::BAD_PAR>();
+    }
+
+    s();
+
+    UNREACHED;
+}
+
+void Ec::batch_done()
+{
+    Ec *ec = current;
+    Sys_regs *r = ec->sys_regs();
+    mword *e = ec->utcb->untyped() + ec->batch_pos * Sys_misc::batch_words;
+
+    e[0] = r->ARG_1;
+    e[1] = r->ARG_2;
+    e[2] = r->ARG_3;
+    e[3] = r->ARG_4;
+    e[4] = r->ARG_5;
+
+    bool const fail = r->status() != Sys_regs::SUCCESS;
+
+    /* a recall or single step is delivered to user space, so the batch ends early */
+    bool const stop = ec->regs.hazard() & (HZD_RECALL | HZD_STEP);
+
+    if (++ec->batch_pos == ec->batch || (fail && ec->batch_stop) || stop) {
+        if (!fail)
+            r->set_status (ec->batch_pos == ec->batch ? Sys_regs::SUCCESS : Sys_regs::COM_ABT);
+
+        r->ARG_2 = ec->batch_pos;
+
+        ec->batch = 0;
+        ec->cont  = ret_user_sysexit;
+
+        ret_user_sysexit();
+    }
+
+    /* continue with the next entry on a fresh stack, permit preemption in between */
+    ec->cont = batch_run;
+
+    Cpu::preemption_point();
+
+    mword hzd = Cpu::hazard & (HZD_RCU | HZD_SCHED);
+    if (EXPECT_FALSE (hzd))
+        handle_hazard (hzd, batch_run);
+
+    asm volatile ("mov %0," EXPAND (PREG(sp);) "jmp *%1" : : "g" (CPU_LOCAL_STCK + PAGE_SIZE), "q" (batch_run) : "memory"); UNREACHED;
+}
+
 template void Ec::sys_finish<Sys_regs::COM_ABT>();
 template void Ec::send_msg<Ec::ret_user_vmresume>();
 template void Ec::send_msg<Ec::ret_user_vmrun>();
@@ -15,57 +15,138 @@
  * GNU General Public License version 2 for more details.
  */
 
+#include "counter.hpp"
 #include "lapic.hpp"
 #include "timeout.hpp"
 #include "x86.hpp"
 #include "assert.hpp"
 
 Timeout *Timeout::list;
+uint64   Timeout::armed;
 
-void Timeout::enqueue (uint64 t)
+/*
+ * Program the LAPIC timer for the earliest deadline. A pending timer that
+ * fires no later than the new deadline is kept, because an early interrupt
+ * merely makes Timeout::check re-arm the timer. This saves the MMIO/MSR
+ * write for the common case of a budget timeout moving into the future on
+ * every context switch.
+ */
+void Timeout::program (uint64 t, bool force)
 {
+    if (EXPECT_TRUE (!force && armed <= t && armed > Lapic::time())) {
+        Counter::timer_skip++;
+        return;
+    }
 
-    assert(prev == nullptr);
-    assert(next == nullptr);
+    Counter::timer_set++;
 
-    time = t;
+    armed = t;
+    Lapic::set_timer (t);
+}
 
-    Timeout *p = nullptr;
+/*
+ * Link root b below root a or vice versa, return the earlier one.
+ */
+Timeout *Timeout::meld (Timeout *a, Timeout *b)
+{
+    if (b->time < a->time) {
+        Timeout *t = a; a = b; b = t;
+    }
 
-    for (Timeout *n = list; n; p = n, n = n->next)
-        if (n->time >= time)
-            break;
+    b->prev = a;
+    b->next = a->child;
 
-    prev = p;
+    if (a->child)
+        a->child->prev = b;
 
-    if (!p) {
-        next = list;
-        list = this;
-        Lapic::set_timer (time);
-    } else {
-        next = p->next;
-        p->next = this;
+    a->child = b;
+
+    return a;
+}
+
+/*
+ * Two-pass pairing of a sibling list into a single heap.
+ */
+Timeout *Timeout::merge_pairs (Timeout *first)
+{
+    Timeout *pairs = nullptr;
+
+    // Left to right: meld adjacent siblings, stack the results
+    while (first) {
+        Timeout *a = first, *b = a->next;
+
+        first = b ? b->next : nullptr;
+
+        a->prev = a->next = nullptr;
+
+        if (b) {
+            b->prev = b->next = nullptr;
+            a = meld (a, b);
+        }
+
+        a->next = pairs;
+        pairs = a;
     }
 
-    if (next)
-        next->prev = this;
+    Timeout *root = nullptr;
+
+    // Right to left: meld the stacked pairs into one heap
+    while (pairs) {
+        Timeout *a = pairs;
+        pairs = a->next;
+        a->next = nullptr;
+        root = root ? meld (root, a) : a;
+    }
+
+    if (root)
+        root->prev = nullptr;
+
+    return root;
+}
+
+void Timeout::enqueue (uint64 t)
+{
+    assert (!active());
+    assert (child == nullptr);
+
+    time = t;
+
+    if (!list || time < list->time) {
+        if (list)
+            meld (this, list);
+
+        list = this;
+        program (time);
+    } else
+        meld (list, this);
 }
 
 uint64 Timeout::dequeue()
 {
     if (active()) {
 
-        if (next)
-            next->prev = prev;
+        Timeout *sub = merge_pairs (child);
+
+        if (list == this) {
+            if ((list = sub))
+                program (list->time);
+        } else {
+
+            // Unlink from parent or previous sibling
+            if (prev->child == this)
+                prev->child = next;
+            else
+                prev->next = next;
 
-        if (prev)
-            prev->next = next;
+            if (next)
+                next->prev = prev;
 
-        else if ((list = next))
-            Lapic::set_timer (list->time);
+            if (sub)
+                meld (list, sub);
+        }
     }
 
-    prev = next = nullptr;
+    prev = next = child = nullptr;
 
     return time;
 }
@@ -82,16 +163,17 @@ void Timeout::check()
 
     if (list && (list == prev_list)) {
         /*
-         * No timeout was dequeued, which can happen if the TSC stops in CPU
-         * sleep states (non-invariant TSC). In that case, we program the
-         * LAPIC again for the next timeout.
+         * No timeout was dequeued, which happens if the timer was left armed
+         * for an earlier deadline (see Timeout::program) or if the TSC stops
+         * in CPU sleep states (non-invariant TSC). In that case, we program
+         * the LAPIC again for the next timeout.
          */
-         Lapic::set_timer(list->time);
+         program (list->time, true);
     }
 }
 
 void Timeout::sync()
 {
     if (list)
-         Lapic::set_timer(list->time);
+         program (list->time, true);
 }
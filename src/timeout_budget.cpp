@@ -16,6 +16,7 @@
  */
 
 #include "cpu.hpp"
+#include "ec.hpp"
 #include "hazards.hpp"
 #include "initprio.hpp"
 #include "timeout_budget.hpp"
@@ -25,5 +26,12 @@ Timeout_budget Timeout_budget::budget;
 
 void Timeout_budget::trigger()
 {
+    Sc_trace::event (Sc_trace::BUDGET, Sc::current->slot, Sc::current->prio, time);
+
     Cpu::hazard |= HZD_SCHED;
 }
+
+void Timeout_replenish::trigger()
+{
+    sc->ready_enqueue (time, false);
+}